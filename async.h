@@ -0,0 +1,546 @@
+/* async.h Copyright 2019, 2023 TNPLR
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef ASYNC_H_
+#define ASYNC_H_
+
+#if !__cpp_impl_coroutine
+#error "async.h needs C++20 coroutines, e.g. -std=c++20"
+#endif // !__cpp_impl_coroutine
+
+#include "poker.h"
+
+#include <condition_variable>
+#include <coroutine>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+/*
+ * Coroutine game loops
+ * A game is a coroutine which suspends while it waits for a player, so one thread
+ * runs any number of games and a waiting game costs only its coroutine frame.
+ * E.g.
+ *     pk::task<> hand(pk::async_table& table)
+ *     {
+ *         table.game().shuffle(generator);
+ *         table.game().deal(5);
+ *         for (unsigned int p = 0; ; p = (p + 1) % table.game().player_count()) {
+ *             pk::card c = co_await table.turn(p);
+ *             ...
+ *         }
+ *     }
+ *
+ *     pk::game_loop loop;
+ *     pk::async_table table(loop, game);
+ *     loop.spawn(hand(table));
+ *     // on a network thread:
+ *     loop.post([&] { table.act(p, {pk::player_action::kind::play, c}); });
+ *     // on the loop thread:
+ *     loop.run();
+ *
+ * Everything but game_loop::post and game_loop::stop belongs to the loop thread.
+ */
+namespace pk {
+
+template <class T = void>
+class task;
+
+namespace detail {
+struct task_promise_base {
+	/** Resumes the awaiting coroutine, if any, when the task ends */
+	struct final_awaiter {
+		bool await_ready() const noexcept
+		{
+			return false;
+		}
+
+		template <class P>
+		std::coroutine_handle<> await_suspend(std::coroutine_handle<P> h) noexcept
+		{
+			return h.promise().continuation;
+		}
+
+		void await_resume() const noexcept
+		{
+		}
+	};
+
+	std::suspend_always initial_suspend() const noexcept
+	{
+		return {};
+	}
+
+	final_awaiter final_suspend() const noexcept
+	{
+		return {};
+	}
+
+	void unhandled_exception() noexcept
+	{
+		error = std::current_exception();
+	}
+
+	std::coroutine_handle<> continuation = std::noop_coroutine();
+	std::exception_ptr error;
+};
+
+template <class T>
+struct task_promise : task_promise_base {
+	task<T> get_return_object() noexcept;
+
+	void return_value(T v)
+	{
+		value.emplace(std::move(v));
+	}
+
+	T result()
+	{
+		if (error) {
+			std::rethrow_exception(error);
+		}
+		return std::move(*value);
+	}
+
+	std::optional<T> value;
+};
+
+template <>
+struct task_promise<void> : task_promise_base {
+	task<void> get_return_object() noexcept;
+
+	void return_void() const noexcept
+	{
+	}
+
+	void result() const
+	{
+		if (error) {
+			std::rethrow_exception(error);
+		}
+	}
+};
+} // namespace detail
+
+/**
+ * A lazy coroutine giving a T
+ * A task starts when it is awaited, and resumes its awaiter when it ends.
+ */
+template <class T>
+class [[nodiscard]] task {
+public:
+	using promise_type = detail::task_promise<T>;
+
+	explicit task(std::coroutine_handle<promise_type> h) noexcept : handle{h}
+	{
+	}
+
+	task(task&& rop) noexcept : handle{std::exchange(rop.handle, nullptr)}
+	{
+	}
+
+	task& operator=(task&& rop) noexcept
+	{
+		if (this != &rop) {
+			if (handle) {
+				handle.destroy();
+			}
+			handle = std::exchange(rop.handle, nullptr);
+		}
+		return *this;
+	}
+
+	task(task const&) = delete;
+	task& operator=(task const&) = delete;
+
+	~task()
+	{
+		if (handle) {
+			handle.destroy();
+		}
+	}
+
+	/** @return Whether the task has ended */
+	inline bool done() const noexcept
+	{
+		return !handle || handle.done();
+	}
+
+	bool await_ready() const noexcept
+	{
+		return done();
+	}
+
+	std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept
+	{
+		handle.promise().continuation = awaiting;
+		return handle;
+	}
+
+	T await_resume()
+	{
+		return handle.promise().result();
+	}
+
+private:
+	std::coroutine_handle<promise_type> handle;
+};
+
+namespace detail {
+template <class T>
+task<T> task_promise<T>::get_return_object() noexcept
+{
+	return task<T>{std::coroutine_handle<task_promise<T>>::from_promise(*this)};
+}
+
+inline task<void> task_promise<void>::get_return_object() noexcept
+{
+	return task<void>{std::coroutine_handle<task_promise<void>>::from_promise(*this)};
+}
+
+/** A coroutine which owns itself: it is freed when it ends */
+struct detached {
+	struct promise_type {
+		detached get_return_object() noexcept
+		{
+			return detached{std::coroutine_handle<promise_type>::from_promise(*this)};
+		}
+
+		std::suspend_always initial_suspend() const noexcept
+		{
+			return {};
+		}
+
+		std::suspend_never final_suspend() const noexcept
+		{
+			return {};
+		}
+
+		void return_void() const noexcept
+		{
+		}
+
+		void unhandled_exception() const noexcept
+		{
+			std::terminate();
+		}
+	};
+
+	std::coroutine_handle<promise_type> handle;
+};
+} // namespace detail
+
+/**
+ * The scheduler of the games of one thread
+ * A resumed coroutine runs until it suspends again; the loop never preempts it.
+ */
+class game_loop {
+public:
+	game_loop() = default;
+	game_loop(game_loop const&) = delete;
+	game_loop& operator=(game_loop const&) = delete;
+
+	/** Destroy the games still suspended */
+	~game_loop()
+	{
+		for (std::coroutine_handle<> h : roots) {
+			if (h) {
+				h.destroy();
+			}
+		}
+	}
+
+	/** Start a game on the next run
+	 * The loop owns the game until it ends. An exception of the game is rethrown by run_ready() or run().
+	 * @param game The game
+	 */
+	void spawn(task<> game)
+	{
+		const std::size_t slot = free_slots.empty() ? roots.size() : free_slots.back();
+		detail::detached root = drive(std::move(game), slot);
+		if (slot == roots.size()) {
+			roots.push_back(root.handle);
+		} else {
+			free_slots.pop_back();
+			roots[slot] = root.handle;
+		}
+		++running;
+		schedule(root.handle);
+	}
+
+	/** Resume a coroutine on the next run */
+	void schedule(std::coroutine_handle<> h)
+	{
+		ready.push_back(h);
+	}
+
+	/** Run a function on the loop thread, from any thread */
+	void post(std::function<void()> fn)
+	{
+		{
+			std::lock_guard<std::mutex> guard{lock};
+			inbox.push_back(std::move(fn));
+		}
+		wakeup.notify_one();
+	}
+
+	/** Make run() return once it is idle, from any thread */
+	void stop()
+	{
+		{
+			std::lock_guard<std::mutex> guard{lock};
+			stopping = true;
+		}
+		wakeup.notify_one();
+	}
+
+	/** Run the posted functions and the ready coroutines until there are none
+	 * @return The number of coroutines resumed
+	 */
+	std::size_t run_ready()
+	{
+		std::size_t resumed = 0;
+		for (;;) {
+			take_inbox();
+			if (ready.empty()) {
+				break;
+			}
+			while (!ready.empty()) {
+				std::coroutine_handle<> h = ready.front();
+				ready.pop_front();
+				h.resume();
+				++resumed;
+				rethrow_error();
+			}
+		}
+		return resumed;
+	}
+
+	/** Run until stop() is called, sleeping while there is nothing to do */
+	void run()
+	{
+		for (;;) {
+			run_ready();
+			std::unique_lock<std::mutex> guard{lock};
+			wakeup.wait(guard, [this] { return stopping || !inbox.empty(); });
+			if (stopping && inbox.empty()) {
+				stopping = false;
+				return;
+			}
+		}
+	}
+
+	/** @return The number of spawned games which have not ended */
+	inline std::size_t active() const
+	{
+		return running;
+	}
+
+private:
+	detail::detached drive(task<> game, std::size_t slot)
+	{
+		try {
+			co_await game;
+		} catch (...) {
+			if (!error) {
+				error = std::current_exception();
+			}
+		}
+		roots[slot] = nullptr;
+		free_slots.push_back(slot);
+		--running;
+	}
+
+	void take_inbox()
+	{
+		std::vector<std::function<void()>> fns;
+		{
+			std::lock_guard<std::mutex> guard{lock};
+			fns.swap(inbox);
+		}
+		for (auto& fn : fns) {
+			fn();
+		}
+	}
+
+	void rethrow_error()
+	{
+		if (error) {
+			std::rethrow_exception(std::exchange(error, nullptr));
+		}
+	}
+
+	std::deque<std::coroutine_handle<>> ready;
+	std::vector<std::coroutine_handle<>> roots; /**< The games not ended, to destroy with the loop */
+	std::vector<std::size_t> free_slots;
+	std::size_t running = 0;
+	std::exception_ptr error;
+
+	std::mutex lock; /**< Guards inbox and stopping */
+	std::condition_variable wakeup;
+	std::vector<std::function<void()>> inbox;
+	bool stopping = false;
+};
+
+/**
+ * Values a coroutine waits for
+ * co_await gives the oldest value given by set(), waiting for one if there is none;
+ * the awaiting coroutine is resumed by the loop, not inside set(). One coroutine
+ * awaits at a time.
+ */
+template <class T>
+class async_input {
+public:
+	explicit async_input(game_loop& lp) : loop{&lp}
+	{
+	}
+
+	async_input(async_input const&) = delete;
+	async_input& operator=(async_input const&) = delete;
+
+	/** Give a value to the awaiting coroutine, or queue it for the next one */
+	void set(T v)
+	{
+		values.push_back(std::move(v));
+		if (waiter) {
+			loop->schedule(std::exchange(waiter, nullptr));
+		}
+	}
+
+	/** @return Whether a coroutine is waiting for the value */
+	inline bool waiting() const noexcept
+	{
+		return static_cast<bool>(waiter);
+	}
+
+	/** The awaiter of co_await on an input */
+	struct awaiter {
+		bool await_ready() const noexcept
+		{
+			return !in->values.empty();
+		}
+
+		void await_suspend(std::coroutine_handle<> h)
+		{
+			if (in->waiter) {
+				throw std::logic_error("Another coroutine is waiting for the input");
+			}
+			in->waiter = h;
+		}
+
+		T await_resume()
+		{
+			T v = std::move(in->values.front());
+			in->values.pop_front();
+			return v;
+		}
+
+		async_input *in;
+	};
+
+	awaiter operator co_await() noexcept
+	{
+		return awaiter{this};
+	}
+
+private:
+	game_loop *loop;
+	std::deque<T> values; /**< The values not taken yet */
+	std::coroutine_handle<> waiter;
+};
+
+/** An action of a player */
+struct player_action {
+	/** This enumerator is the kind of an action */
+	enum class kind {
+		draw, /**< Draw a card from the pile */
+		play, /**< Play the card c */
+		pass, /**< Do nothing */
+	};
+
+	kind what = kind::pass;
+	card c{}; /**< The card to play */
+};
+
+/**
+ * A game with an awaitable action per player
+ * The actions come from act(), e.g. posted to the loop by the network.
+ */
+class async_table {
+public:
+	/** @param lp The loop of the games of the table
+	 * @param g The game, which must outlive the table
+	 */
+	async_table(game_loop& lp, poker& g) : table{&g}
+	{
+		seats.reserve(g.player_count());
+		for (unsigned int i = 0; i < g.player_count(); ++i) {
+			seats.emplace_back(new async_input<player_action>{lp});
+		}
+	}
+
+	/** @return The game */
+	inline poker& game() const
+	{
+		return *table;
+	}
+
+	/** @return The awaitable next action of a player */
+	async_input<player_action>& input(unsigned int player_no)
+	{
+		if (player_no >= seats.size()) {
+			throw std::out_of_range("The player number is too large");
+		}
+		return *seats[player_no];
+	}
+
+	/** Queue the next action of a player */
+	void act(unsigned int player_no, player_action a)
+	{
+		input(player_no).set(a);
+	}
+
+	/** Wait for the next action of a player and apply it to the game
+	 * @param player_no The number of the player
+	 * @return The card drawn or played, or no card (number 0) for a pass
+	 */
+	task<card> turn(unsigned int player_no)
+	{
+		player_action a = co_await input(player_no);
+		switch (a.what) {
+		case player_action::kind::draw:
+			co_return table->draw(player_no);
+		case player_action::kind::play:
+			table->play(player_no, a.c);
+			co_return a.c;
+		case player_action::kind::pass:
+			break;
+		}
+		co_return card{};
+	}
+
+private:
+	poker *table;
+	std::vector<std::unique_ptr<async_input<player_action>>> seats;
+};
+
+} // namespace pk
+#endif // ASYNC_H_
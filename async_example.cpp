@@ -0,0 +1,97 @@
+/* async_example.cpp Copyright 2019, 2023 TNPLR
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Many games on one thread with async.h, which needs C++20
+ *     g++ -std=c++20 -O2 -pthread async_example.cpp poker.cpp -o async_example
+ *     ./async_example [TABLES]
+ * Every table is a coroutine on one game_loop. Another thread plays the network:
+ * it posts the actions of every player, which the games await in turn. Each game
+ * deals 5 cards, then every player draws until the pile is empty and passes once.
+ * The exit status is 1 if a game does not end with the hands it should.
+ */
+#include "async.h"
+#include "rng.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace {
+
+constexpr unsigned int players = 4;
+constexpr unsigned int dealt = 5;
+constexpr unsigned int draws = (52 - players * dealt) / players;
+
+pk::task<> hand(pk::async_table& table, pk::game_loop& loop, unsigned int& left)
+{
+	pk::xoshiro256ss generator{reinterpret_cast<std::uintptr_t>(&table)};
+	table.game().shuffle(generator);
+	table.game().deal(dealt);
+	for (unsigned int round = 0; round <= draws; ++round) {
+		for (unsigned int p = 0; p < players; ++p) {
+			co_await table.turn(p);
+		}
+	}
+	if (--left == 0) {
+		loop.stop();
+	}
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+	const unsigned int tables = argc > 1 ? static_cast<unsigned int>(std::strtoul(argv[1], nullptr, 10)) : 1000;
+	pk::game_loop loop;
+	std::vector<std::unique_ptr<pk::poker>> games;
+	std::vector<std::unique_ptr<pk::async_table>> seats;
+	unsigned int left = tables;
+	for (unsigned int i = 0; i < tables; ++i) {
+		games.emplace_back(new pk::poker(1, players));
+		seats.emplace_back(new pk::async_table(loop, *games.back()));
+		loop.spawn(hand(*seats.back(), loop, left));
+	}
+	if (tables == 0) {
+		loop.stop();
+	}
+
+	std::thread network([&] {
+		for (unsigned int round = 0; round <= draws; ++round) {
+			for (unsigned int i = 0; i < tables; ++i) {
+				for (unsigned int p = 0; p < players; ++p) {
+					const pk::player_action a{round < draws ? pk::player_action::kind::draw : pk::player_action::kind::pass, {}};
+					loop.post([&seats, i, p, a] { seats[i]->act(p, a); });
+				}
+			}
+		}
+	});
+	loop.run();
+	network.join();
+
+	unsigned int bad = 0;
+	for (auto const& g : games) {
+		bool ok = g->card_pile().size() == 0;
+		for (unsigned int p = 0; p < players; ++p) {
+			ok = ok && (*g)[p].size() == dealt + draws;
+		}
+		bad += !ok;
+	}
+	std::cout << tables << " tables on one thread, " << loop.active() << " still running, " << bad << " wrong\n";
+	return bad || loop.active() ? 1 : 0;
+}
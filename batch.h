@@ -0,0 +1,216 @@
+/* batch.h Copyright 2019, 2023 TNPLR
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef BATCH_H_
+#define BATCH_H_
+
+#include "poker.h"
+#include "serialize.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+namespace pk {
+
+/**
+ * K tables of the same kind, shuffled and dealt together
+ * The piles of every table are one contiguous array of bytes (the card bytes of
+ * serialize.h), table after table. Dealing moves no card: like poker::deal, cards
+ * are dealt round-robin from the back of the pile, so card i of player p is at
+ * pile position size - 1 - (i * players + p), and a hand is just an offset.
+ * E.g.
+ *     pk::poker_batch tables(1024, 1, 9);
+ *     tables.shuffle(generator);
+ *     tables.deal(2);
+ *     pk::card_set hole = tables.hand(k, p);
+ */
+class poker_batch {
+public:
+	/** A constructor of a batch of tables
+	 * @param tables The number of tables
+	 * @param deck The number of decks of each pile. Default to 1.
+	 * @param player The players of each table. Default to 2.
+	 * @param joker Whether the jokers should be put into each pile. Default to false.
+	 */
+	explicit poker_batch(std::size_t tables, unsigned int deck = 1, unsigned int player = 2, bool joker = false)
+		: count{tables}, players{player}, decks{deck}, joker{joker}, pile_size{deck * (joker ? 54u : 52u)}
+	{
+		if (player == 0) {
+			throw std::invalid_argument("Argument \'player\' cannot be zero");
+		}
+		poker layout(deck, 1, joker);
+		initial.resize(pile_size);
+		for (unsigned int i = 0; i < pile_size; ++i) {
+			initial[i] = to_byte(layout.card_pile()[i]);
+		}
+		cards.resize(count * pile_size);
+		random.resize(count);
+		reset();
+	}
+
+	/** Put every card of every table back into the pile in the initial order */
+	void reset()
+	{
+		for (std::size_t k = 0; k < count; ++k) {
+			std::copy(initial.begin(), initial.end(), cards.begin() + k * pile_size);
+		}
+		dealt = 0;
+	}
+
+	/** Shuffle the pile of every table with a uniform permutation
+	 * One interleaved Fisher-Yates pass: at step i, the random numbers of all tables are
+	 * drawn in one run and bounded by the same range, so the rejection threshold is
+	 * computed once per step instead of once per table.
+	 * @param generator A uniform random bit generator with at least 32 random bits
+	 */
+	template <class URBG>
+	void shuffle(URBG& generator)
+	{
+		static_assert(URBG::min() == 0 && URBG::max() >= 0xFFFFFFFFu, "The generator must give at least 32 random bits");
+		dealt = 0;
+		if (pile_size < 2) {
+			return;
+		}
+		std::uint8_t *base = cards.data();
+		for (unsigned int i = pile_size - 1; i > 0; --i) {
+			const std::uint32_t range = i + 1;
+			const std::uint32_t threshold = -range % range;
+			for (std::size_t k = 0; k < count; ++k) {
+				random[k] = static_cast<std::uint32_t>(generator());
+			}
+			for (std::size_t k = 0; k < count; ++k) {
+				std::uint64_t m = static_cast<std::uint64_t>(random[k]) * range;
+				while (static_cast<std::uint32_t>(m) < threshold) {
+					m = static_cast<std::uint64_t>(static_cast<std::uint32_t>(generator())) * range;
+				}
+				std::uint8_t *pile = base + k * pile_size;
+				std::swap(pile[i], pile[m >> 32]);
+			}
+		}
+	}
+
+	/** Deal some card to each person of every table.
+	 * @param card_per_person How many card should the function deal to each player.
+	 */
+	void deal(unsigned int card_per_person)
+	{
+		if (static_cast<std::uint64_t>(dealt + card_per_person) * players > pile_size) {
+			throw std::out_of_range("Not enough cards in the pile");
+		}
+		dealt += card_per_person;
+	}
+
+	/** @return The number of tables */
+	inline std::size_t size() const
+	{
+		return count;
+	}
+
+	/** @return The number of players of each table */
+	inline unsigned int player_count() const
+	{
+		return players;
+	}
+
+	/** @return The number of cards dealt to each player */
+	inline unsigned int hand_size() const
+	{
+		return dealt;
+	}
+
+	/** @return The number of cards of a full pile */
+	inline unsigned int full_pile_size() const
+	{
+		return pile_size;
+	}
+
+	/** @return The card bytes of the pile of a table, of full_pile_size() bytes */
+	inline std::uint8_t const *table_cards(std::size_t table) const
+	{
+		return cards.data() + table * pile_size;
+	}
+
+	/** A card of a player
+	 * @param table The table number
+	 * @param player_no The number of the player
+	 * @param index The index of the card in the player's hand, less than hand_size()
+	 * @return The card
+	 */
+	inline card hand_card(std::size_t table, unsigned int player_no, unsigned int index) const
+	{
+		std::uint8_t byte = table_cards(table)[pile_size - 1 - (index * players + player_no)];
+		return card{static_cast<unsigned short>(byte >> 4), static_cast<unsigned short>(byte & 0x0F)};
+	}
+
+	/** The hand of a player as a card_set
+	 * @param table The table number
+	 * @param player_no The number of the player
+	 * @return The cards of the hand
+	 */
+	inline card_set hand(std::size_t table, unsigned int player_no) const
+	{
+		card_set cs;
+		for (unsigned int i = 0; i < dealt; ++i) {
+			cs.insert(hand_card(table, player_no, i));
+		}
+		return cs;
+	}
+
+	/** Copy one table into a game
+	 * @param table The table number
+	 * @param pk The game, replaced by the pile and hands of the table
+	 */
+	void export_table(std::size_t table, poker& pk) const
+	{
+		std::vector<unsigned char> buf;
+		buf.reserve(16 + pile_size * 2 + players * 8);
+		std::uint8_t const *pile = table_cards(table);
+		const unsigned int left = pile_size - dealt * players;
+		buf.push_back(poker_format_version);
+		push_varint(buf, players);
+		push_varint(buf, decks);
+		buf.push_back(joker);
+		push_varint(buf, left);
+		buf.insert(buf.end(), pile, pile + left);
+		for (unsigned int p = 0; p < players; ++p) {
+			push_varint(buf, dealt);
+			for (unsigned int i = 0; i < dealt; ++i) {
+				buf.push_back(pile[pile_size - 1 - (i * players + p)]);
+			}
+		}
+		decode(buf.data(), buf.size(), pk);
+	}
+
+private:
+	static void push_varint(std::vector<unsigned char>& buf, std::uint64_t v)
+	{
+		unsigned char tmp[10];
+		buf.insert(buf.end(), tmp, detail::put_varint(tmp, v));
+	}
+
+	std::size_t count; /**< The number of tables */
+	unsigned int players; /**< The players of each table */
+	unsigned int decks; /**< The number of decks of each pile */
+	bool joker; /**< Whether each pile has jokers */
+	unsigned int pile_size; /**< The cards of a full pile */
+	unsigned int dealt = 0; /**< The cards dealt to each player */
+	std::vector<std::uint8_t> initial; /**< The full pile in the initial order */
+	std::vector<std::uint8_t> cards; /**< The piles of every table */
+	std::vector<std::uint32_t> random; /**< Random numbers of one Fisher-Yates step */
+};
+
+} // namespace pk
+#endif // BATCH_H_
@@ -0,0 +1,424 @@
+/* bench.cpp Copyright 2019, 2023 TNPLR
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Benchmarks of the hot paths, with Google Benchmark
+ *     g++ -std=c++17 -O2 bench.cpp poker.cpp -lbenchmark -lpthread -o bench
+ *     ./bench --write-baseline=bench_baseline.txt
+ *     ./bench --baseline=bench_baseline.txt --tolerance=25
+ * With --baseline, every benchmark slower than the baseline by more than the
+ * tolerance (in percent, default 25) is reported and the exit status is 1.
+ */
+#include "poker.h"
+#include "rng.h"
+#include "evaluator.h"
+#include "batch.h"
+#include "snapshot.h"
+#include "isomorphism.h"
+
+#include <benchmark/benchmark.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <ostream>
+#include <random>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+namespace {
+
+/** A stream buffer which drops everything, so printing is timed without I/O */
+class null_buffer : public std::streambuf {
+protected:
+	int overflow(int c) override { return c; }
+	std::streamsize xsputn(char const *, std::streamsize n) override { return n; }
+};
+
+template <class URBG>
+void bm_shuffle_fisher_yates(benchmark::State& state)
+{
+	pk::poker game(static_cast<unsigned int>(state.range(0)), 1);
+	URBG generator(1);
+	for (auto _ : state) {
+		game.shuffle(generator);
+		benchmark::ClobberMemory();
+	}
+	state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_TEMPLATE(bm_shuffle_fisher_yates, std::mt19937_64)->Arg(1)->Arg(8);
+BENCHMARK_TEMPLATE(bm_shuffle_fisher_yates, pk::xoshiro256ss)->Arg(1)->Arg(8);
+BENCHMARK_TEMPLATE(bm_shuffle_fisher_yates, pk::pcg64)->Arg(1)->Arg(8);
+BENCHMARK_TEMPLATE(bm_shuffle_fisher_yates, pk::philox4x32)->Arg(1)->Arg(8);
+
+template <class URBG>
+void bm_shuffle_random_swap(benchmark::State& state)
+{
+	pk::poker game(1, 1);
+	URBG generator(1);
+	for (auto _ : state) {
+		game.shuffle(generator, pk::poker::shuffle_mode::random_swap, 1000);
+		benchmark::ClobberMemory();
+	}
+	state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_TEMPLATE(bm_shuffle_random_swap, std::mt19937_64);
+BENCHMARK_TEMPLATE(bm_shuffle_random_swap, pk::xoshiro256ss);
+
+/** The original entry point: a fresh std::random_device and engine per call */
+void bm_shuffle_default(benchmark::State& state)
+{
+	pk::poker game(1, 1);
+	for (auto _ : state) {
+		game.shuffle();
+		benchmark::ClobberMemory();
+	}
+	state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(bm_shuffle_default);
+
+void bm_batch_shuffle(benchmark::State& state)
+{
+	pk::poker_batch tables(static_cast<std::size_t>(state.range(0)));
+	pk::xoshiro256ss generator(1);
+	for (auto _ : state) {
+		tables.shuffle(generator);
+		tables.deal(2);
+		benchmark::ClobberMemory();
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(bm_batch_shuffle)->Arg(1024);
+
+/** reset + deal: args are decks, players and cards per player */
+void bm_deal(benchmark::State& state)
+{
+	pk::poker game(static_cast<unsigned int>(state.range(0)), static_cast<unsigned int>(state.range(1)));
+	const unsigned int cards = static_cast<unsigned int>(state.range(2));
+	for (auto _ : state) {
+		game.reset();
+		game.deal(cards);
+		benchmark::ClobberMemory();
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(1) * state.range(2));
+}
+BENCHMARK(bm_deal)->Args({1, 2, 2})->Args({1, 9, 2})->Args({1, 4, 13})->Args({8, 6, 10});
+
+void bm_deal_fixed_hand(benchmark::State& state)
+{
+	pk::poker game(1, 9);
+	pk::fixed_hand<2> hands[9];
+	for (auto _ : state) {
+		game.reset();
+		for (auto& h : hands) {
+			h.clear();
+		}
+		game.deal(2, hands);
+		benchmark::ClobberMemory();
+	}
+	state.SetItemsProcessed(state.iterations() * 18);
+}
+BENCHMARK(bm_deal_fixed_hand);
+
+/** Rounds of an 8-deck shoe of 7 players, cut at 75%: arg 0 shuffles the shoe at the cut card, arg 1 draws lazily */
+void bm_shoe_round(benchmark::State& state)
+{
+	pk::poker shoe(8, 7);
+	shoe.set_penetration(0.75);
+	pk::xoshiro256ss generator(1);
+	const bool lazy = state.range(0) == 1;
+	for (auto _ : state) {
+		if (shoe.needs_reshuffle()) {
+			shoe.reset();
+			if (!lazy) {
+				shoe.shuffle(generator);
+			}
+		}
+		for (unsigned int p = 0; p < shoe.player_count(); ++p) {
+			shoe[p].clear();
+		}
+		if (lazy) {
+			shoe.deal(2, generator);
+		} else {
+			shoe.deal(2);
+		}
+		benchmark::ClobberMemory();
+	}
+	state.SetItemsProcessed(state.iterations() * 14);
+}
+BENCHMARK(bm_shoe_round)->Arg(0)->Arg(1);
+
+/** Fork a 9-player hand of one deck: restore a snapshot with its engine and draw */
+void bm_snapshot_fork(benchmark::State& state)
+{
+	pk::poker game(1, 9);
+	pk::xoshiro256ss generator(1);
+	game.shuffle(generator);
+	game.deal(2);
+	pk::poker_snapshot root;
+	root.save(game, generator);
+	for (auto _ : state) {
+		root.restore(game, generator);
+		benchmark::DoNotOptimize(game.draw(0));
+	}
+}
+BENCHMARK(bm_snapshot_fork);
+
+/** Sort a shuffled deck: args are sort_mode and decks */
+void bm_sort(benchmark::State& state)
+{
+	const auto mode = static_cast<pk::deck::sort_mode>(state.range(0));
+	pk::poker game(static_cast<unsigned int>(state.range(1)), 1);
+	pk::xoshiro256ss generator(1);
+	game.shuffle(generator);
+	game.deal(static_cast<unsigned int>(game.card_pile().size()));
+	const pk::deck shuffled = game[0];
+	pk::deck dk = shuffled;
+	for (auto _ : state) {
+		state.PauseTiming();
+		dk = shuffled;
+		state.ResumeTiming();
+		dk.sort(mode);
+		benchmark::ClobberMemory();
+	}
+	state.SetItemsProcessed(state.iterations() * static_cast<long>(shuffled.size()));
+}
+BENCHMARK(bm_sort)->Args({0, 1})->Args({1, 1})->Args({0, 8})->Args({1, 8});
+
+void bm_sort_player_card(benchmark::State& state)
+{
+	pk::poker game(1, 4);
+	pk::xoshiro256ss generator(1);
+	for (auto _ : state) {
+		state.PauseTiming();
+		game.reset();
+		game.shuffle(generator);
+		game.deal(13);
+		state.ResumeTiming();
+		game.sort_player_card();
+		benchmark::ClobberMemory();
+	}
+}
+BENCHMARK(bm_sort_player_card);
+
+/** Remove a card from an 8-deck shoe and put it back: arg is the remove_mode */
+void bm_remove(benchmark::State& state)
+{
+	const auto mode = static_cast<pk::deck::remove_mode>(state.range(0));
+	pk::poker game(8, 1);
+	pk::xoshiro256ss generator(1);
+	game.shuffle(generator);
+	pk::deck shoe = game.card_pile();
+	for (auto _ : state) {
+		pk::card c = shoe[pk::detail::bounded_rand(generator, static_cast<std::uint32_t>(shoe.size()))];
+		shoe.remove(c, mode);
+		shoe.push_back(c);
+	}
+}
+BENCHMARK(bm_remove)->Arg(0)->Arg(1);
+
+void bm_remove_indexed(benchmark::State& state)
+{
+	pk::poker game(8, 1);
+	pk::xoshiro256ss generator(1);
+	game.shuffle(generator);
+	pk::indexed_deck shoe{game.card_pile()};
+	for (auto _ : state) {
+		pk::card c = shoe[pk::detail::bounded_rand(generator, static_cast<std::uint32_t>(shoe.size()))];
+		shoe.remove(c);
+		shoe.push_back(c);
+	}
+}
+BENCHMARK(bm_remove_indexed);
+
+/** Print a 13-card hand: arg is the print_mode */
+void bm_print(benchmark::State& state)
+{
+	pk::poker game(1, 4);
+	pk::xoshiro256ss generator(1);
+	game.shuffle(generator);
+	game.deal(13);
+	game[0].set_print_mode(static_cast<pk::deck::print_mode>(state.range(0)));
+	null_buffer buf;
+	std::ostream os(&buf);
+	for (auto _ : state) {
+		os << game[0];
+	}
+}
+BENCHMARK(bm_print)->Arg(0)->Arg(1)->Arg(2)->Arg(3);
+
+void bm_print_poker(benchmark::State& state)
+{
+	pk::poker game(1, 4);
+	null_buffer buf;
+	std::ostream os(&buf);
+	for (auto _ : state) {
+		os << game;
+	}
+}
+BENCHMARK(bm_print_poker);
+
+/** Random 7-card hands, the same for every evaluator benchmark */
+std::vector<pk::card_set> const& random_hands()
+{
+	static const std::vector<pk::card_set> hands = [] {
+		std::vector<pk::card_set> v;
+		pk::xoshiro256ss generator(7);
+		pk::poker game(1, 1);
+		for (int i = 0; i < 65536; ++i) {
+			game.reset();
+			game.shuffle(generator);
+			game.deal(7);
+			v.push_back(pk::card_set{game[0]});
+		}
+		return v;
+	}();
+	return hands;
+}
+
+void bm_evaluate(benchmark::State& state)
+{
+	std::vector<pk::card_set> const& hands = random_hands();
+	std::size_t i = 0;
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(pk::evaluate(hands[i]));
+		i = (i + 1) & (hands.size() - 1);
+	}
+	state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(bm_evaluate);
+
+void bm_evaluate_batch(benchmark::State& state)
+{
+	std::vector<pk::card_set> const& hands = random_hands();
+	pk::hand_batch_buffer buffer;
+	for (pk::card_set cs : hands) {
+		buffer.push_back(cs);
+	}
+	std::vector<pk::hand_strength> out(buffer.size());
+	for (auto _ : state) {
+		pk::evaluate(buffer.view(), out.data());
+		benchmark::ClobberMemory();
+	}
+	state.SetItemsProcessed(state.iterations() * static_cast<long>(buffer.size()));
+}
+BENCHMARK(bm_evaluate_batch);
+
+void bm_hand_index_flop(benchmark::State& state)
+{
+	// The two lowest cards of a random hand are the hole cards, the next three the flop
+	std::vector<pk::card_set> hands;
+	for (pk::card_set cs : random_hands()) {
+		std::uint64_t m = cs.mask(), round[2] = {};
+		for (unsigned int k = 0; k < 5; ++k, m &= m - 1) {
+			round[k >= 2] |= m & -m;
+		}
+		hands.push_back(pk::card_set{round[0]});
+		hands.push_back(pk::card_set{round[1]});
+	}
+	const pk::hand_indexer indexer = pk::hand_indexer::holdem();
+	std::size_t i = 0;
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(indexer.index(&hands[2 * i], 2));
+		i = (i + 1) & (hands.size() / 2 - 1);
+	}
+	state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(bm_hand_index_flop);
+
+/** Records the time per iteration of each benchmark, besides printing it */
+class baseline_reporter : public benchmark::ConsoleReporter {
+public:
+	void ReportRuns(std::vector<Run> const& runs) override
+	{
+		for (Run const& run : runs) {
+			if (run.run_type == Run::RT_Iteration && !run.error_occurred) {
+				ns[run.benchmark_name()] = run.GetAdjustedCPUTime() * benchmark::GetTimeUnitMultiplier(benchmark::kNanosecond)
+					/ benchmark::GetTimeUnitMultiplier(run.time_unit);
+			}
+		}
+		ConsoleReporter::ReportRuns(runs);
+	}
+
+	std::map<std::string, double> ns; /**< CPU time per iteration in nanoseconds */
+};
+
+/** @return The value of a --name=value argument, removed from argv, or an empty string */
+std::string take_flag(int& argc, char **argv, char const *name)
+{
+	const std::string prefix = std::string("--") + name + "=";
+	for (int i = 1; i < argc; ++i) {
+		if (std::strncmp(argv[i], prefix.c_str(), prefix.size()) == 0) {
+			std::string value = argv[i] + prefix.size();
+			for (int j = i; j + 1 < argc; ++j) {
+				argv[j] = argv[j + 1];
+			}
+			--argc;
+			return value;
+		}
+	}
+	return "";
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+	const std::string baseline = take_flag(argc, argv, "baseline");
+	const std::string write = take_flag(argc, argv, "write-baseline");
+	const std::string tolerance_flag = take_flag(argc, argv, "tolerance");
+	const double tolerance = tolerance_flag.empty() ? 25.0 : std::atof(tolerance_flag.c_str());
+
+	benchmark::Initialize(&argc, argv);
+	if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+		return 1;
+	}
+	baseline_reporter reporter;
+	benchmark::RunSpecifiedBenchmarks(&reporter);
+	benchmark::Shutdown();
+
+	if (!write.empty()) {
+		std::ofstream out(write);
+		for (auto const& entry : reporter.ns) {
+			out << entry.first << ' ' << entry.second << '\n';
+		}
+	}
+
+	int status = 0;
+	if (!baseline.empty()) {
+		std::ifstream in(baseline);
+		if (!in) {
+			std::cerr << "Cannot read the baseline " << baseline << '\n';
+			return 1;
+		}
+		std::string name;
+		double ns;
+		while (in >> name >> ns) {
+			auto it = reporter.ns.find(name);
+			if (it == reporter.ns.end()) {
+				continue;
+			}
+			const double change = (it->second - ns) / ns * 100.0;
+			if (change > tolerance) {
+				std::cerr << "REGRESSION " << name << ": " << ns << " ns -> " << it->second << " ns (+" << change << "%)\n";
+				status = 1;
+			}
+		}
+	}
+	return status;
+}
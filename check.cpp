@@ -0,0 +1,1141 @@
+/* check.cpp Copyright 2019, 2023 TNPLR
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * The regression checks of libpk, one ctest test per check
+ *     g++ -std=c++17 -O2 -pthread check.cpp poker.cpp -o check
+ *     ./check [NAME...]
+ * With no name every check runs. A failed condition is printed with its line, and
+ * the exit status is 1 if any failed. The counts checked are references: the
+ * categories of every 5 and 7-card hand, the hand classes of the indexer, and the
+ * boards of the equity requests, which enumeration and sampling must agree on.
+ */
+#include "poker.h"
+#include "rng.h"
+#include "evaluator.h"
+#include "equity.h"
+#include "serialize.h"
+#if __unix__ || __APPLE__
+#include "history.h"
+#include "equity_table.h"
+#endif // __unix__ || __APPLE__
+#include "batch.h"
+#include "snapshot.h"
+#include "range.h"
+#include "isomorphism.h"
+#include "shard.h"
+#include "instrument.h"
+#include "table_service.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <future>
+#include <memory>
+#include <memory_resource>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+unsigned int failures = 0;
+
+void fail(char const *what, int line)
+{
+	std::printf("    line %d: %s\n", line, what);
+	++failures;
+}
+
+#define CHECK(cond) ((cond) ? (void)0 : fail(#cond, __LINE__))
+#define CHECK_THROWS(expr, type) \
+	do { \
+		bool thrown = false; \
+		try { \
+			expr; \
+		} catch (type const&) { \
+			thrown = true; \
+		} \
+		if (!thrown) { \
+			fail(#expr " does not throw " #type, __LINE__); \
+		} \
+	} while (0)
+
+/** @return The mask of card i, 0 - 51, of suit i / 13 */
+std::uint64_t card_bit(unsigned int i)
+{
+	return 1ull << (i / 13 * 16 + i % 13);
+}
+
+/** @return A set of cards by card_bit() index */
+pk::card_set cards(std::initializer_list<unsigned int> list)
+{
+	std::uint64_t m = 0;
+	for (unsigned int i : list) {
+		m |= card_bit(i);
+	}
+	return pk::card_set{m};
+}
+
+/** The categories of every 5 and 7-card hand */
+void check_evaluator()
+{
+	std::uint64_t five[9]{};
+	for (unsigned int a = 0; a < 52; ++a)
+	for (unsigned int b = a + 1; b < 52; ++b)
+	for (unsigned int c = b + 1; c < 52; ++c)
+	for (unsigned int d = c + 1; d < 52; ++d)
+	for (unsigned int e = d + 1; e < 52; ++e) {
+		const std::uint64_t m = card_bit(a) | card_bit(b) | card_bit(c) | card_bit(d) | card_bit(e);
+		++five[static_cast<unsigned int>(pk::category(pk::evaluate(pk::card_set{m})))];
+	}
+	const std::uint64_t five_ref[9]{1302540, 1098240, 123552, 54912, 10200, 5108, 3744, 624, 40};
+	for (unsigned int i = 0; i < 9; ++i) {
+		CHECK(five[i] == five_ref[i]);
+	}
+
+	std::uint64_t seven[9]{};
+	for (unsigned int a = 0; a < 52; ++a) {
+		const std::uint64_t ma = card_bit(a);
+		for (unsigned int b = a + 1; b < 52; ++b) {
+			const std::uint64_t mb = ma | card_bit(b);
+			for (unsigned int c = b + 1; c < 52; ++c) {
+				const std::uint64_t mc = mb | card_bit(c);
+				for (unsigned int d = c + 1; d < 52; ++d) {
+					const std::uint64_t md = mc | card_bit(d);
+					for (unsigned int e = d + 1; e < 52; ++e) {
+						const std::uint64_t me = md | card_bit(e);
+						for (unsigned int f = e + 1; f < 52; ++f) {
+							const std::uint64_t mf = me | card_bit(f);
+							for (unsigned int g = f + 1; g < 52; ++g) {
+								const std::uint64_t m = mf | card_bit(g);
+								++seven[static_cast<unsigned int>(pk::category(pk::evaluate(
+									static_cast<unsigned int>(m & 0x1FFF), static_cast<unsigned int>(m >> 16 & 0x1FFF),
+									static_cast<unsigned int>(m >> 32 & 0x1FFF), static_cast<unsigned int>(m >> 48 & 0x1FFF))))];
+							}
+						}
+					}
+				}
+			}
+		}
+	}
+	const std::uint64_t seven_ref[9]{23294460, 58627800, 31433400, 6461620, 6180020, 4047644, 3473184, 224848, 41584};
+	for (unsigned int i = 0; i < 9; ++i) {
+		CHECK(seven[i] == seven_ref[i]);
+	}
+}
+
+/** Every preflop and flop class is unranked and indexed back, and hands of one class share an index */
+void check_indexer()
+{
+	const pk::hand_indexer indexer = pk::hand_indexer::holdem();
+	CHECK(indexer.size(0) == 169);
+	CHECK(indexer.size(1) == 1286792);
+	CHECK(indexer.size(2) == 55190538);
+	CHECK(indexer.size(3) == 2428287420ull);
+	for (unsigned int round = 0; round < 2; ++round) {
+		for (std::uint64_t i = 0; i < indexer.size(round); ++i) {
+			if (indexer.index(indexer.unrank(round, i)) != i) {
+				fail("index(unrank(i)) != i", __LINE__);
+				return;
+			}
+		}
+	}
+
+	// Swapping suits keeps the index
+	pk::philox4x32 generator(7);
+	for (unsigned int n = 0; n < 20000; ++n) {
+		std::vector<unsigned int> deal(52);
+		for (unsigned int i = 0; i < 52; ++i) {
+			deal[i] = i;
+		}
+		for (unsigned int i = 0; i < 7; ++i) {
+			std::swap(deal[i], deal[i + pk::detail::bounded_rand(generator, 52 - i)]);
+		}
+		unsigned int perm[4]{0, 1, 2, 3};
+		for (unsigned int i = 3; i > 0; --i) {
+			std::swap(perm[i], perm[pk::detail::bounded_rand(generator, i + 1)]);
+		}
+		auto relabel = [&](unsigned int c) { return perm[c / 13] * 13 + c % 13; };
+		std::vector<pk::card_set> hand{cards({deal[0], deal[1]}), cards({deal[2], deal[3], deal[4]}), cards({deal[5]}), cards({deal[6]})};
+		std::vector<pk::card_set> iso{cards({relabel(deal[0]), relabel(deal[1])}),
+			cards({relabel(deal[2]), relabel(deal[3]), relabel(deal[4])}), cards({relabel(deal[5])}), cards({relabel(deal[6])})};
+		const std::uint64_t river = indexer.index(hand);
+		CHECK(river == indexer.index(iso));
+		CHECK(river < indexer.size(3));
+		CHECK(indexer.index(indexer.unrank(3, river)) == river);
+	}
+}
+
+/** deck::sort against std::sort with the comparators it replaced */
+void check_sort()
+{
+	pk::xoshiro256ss generator(3);
+	for (unsigned int n = 0; n < 200; ++n) {
+		pk::poker game(1 + n % 3, 1, n % 2 == 0);
+		game.shuffle(generator);
+		pk::deck dk = game.card_pile();
+		std::vector<pk::card> ref;
+		for (unsigned int i = 0; i < dk.size(); ++i) {
+			ref.push_back(dk[i]);
+		}
+		const bool by_rank = n % 4 < 2;
+		// Strict for equal numbers, which the old comparators were not: two aces of a suit compared less
+		auto higher = [](pk::card const& a, pk::card const& b) {
+			return a.number != b.number && (a.number == 1 || (b.number != 1 && a.number > b.number));
+		};
+		std::sort(ref.begin(), ref.end(), [&](pk::card const& a, pk::card const& b) {
+			if (by_rank) {
+				return a.number != b.number ? higher(a, b) : a.suit > b.suit;
+			}
+			return a.suit == b.suit ? higher(a, b) : a.suit > b.suit;
+		});
+		dk.sort(by_rank ? pk::deck::sort_mode::rank_first_descending : pk::deck::sort_mode::suit_first_descending);
+		CHECK(dk.size() == ref.size());
+		for (unsigned int i = 0; i < dk.size() && i < ref.size(); ++i) {
+			if (!(dk[i] == ref[i])) {
+				fail("deck::sort differs from std::sort", __LINE__);
+				break;
+			}
+		}
+	}
+
+	// Every representable number, twice in every suit, so that no card is dropped
+	pk::deck every;
+	for (unsigned short k = 0; k < 2; ++k) {
+		for (unsigned short number = 0; number < 16; ++number) {
+			for (unsigned short suit = 0; suit < 4; ++suit) {
+				every.push_back(pk::card{suit, number});
+			}
+		}
+	}
+	const unsigned char order[16]{1, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 0};
+	pk::deck by_rank = every;
+	by_rank.sort(pk::deck::sort_mode::rank_first_descending);
+	CHECK(by_rank.size() == 128);
+	for (unsigned int i = 0; i < by_rank.size() && i < 128; ++i) {
+		CHECK(by_rank[i].number == order[i / 8] && by_rank[i].suit == 3 - i / 2 % 4);
+	}
+	pk::deck by_suit = every;
+	by_suit.sort(pk::deck::sort_mode::suit_first_descending);
+	CHECK(by_suit.size() == 128);
+	for (unsigned int i = 0; i < by_suit.size() && i < 128; ++i) {
+		CHECK(by_suit[i].suit == 3 - i / 32 && by_suit[i].number == order[i / 2 % 16]);
+	}
+	std::ostringstream os;
+	every.set_print_mode(pk::deck::print_mode::sort_by_number);
+	os << every;
+	CHECK(os.str().find('?') != std::string::npos);
+}
+
+/** Games and card sets are decoded to what was encoded, and malformed input throws */
+void check_serialize()
+{
+	pk::philox4x32 generator(11);
+	for (unsigned int n = 0; n < 100; ++n) {
+		pk::poker game(1 + n % 2, 2 + n % 5, n % 3 == 0);
+		game.shuffle(generator);
+		game.deal(n % 6);
+		std::vector<unsigned char> buf(pk::encoded_size(game));
+		CHECK(pk::encode(game, buf.data(), buf.size()) == buf.size());
+		pk::poker back;
+		CHECK(pk::decode(buf.data(), buf.size(), back) == buf.size());
+		std::vector<unsigned char> again(pk::encoded_size(back));
+		pk::encode(back, again.data(), again.size());
+		CHECK(buf == again);
+		CHECK_THROWS(pk::encode(game, buf.data(), buf.size() - 1), std::length_error);
+		// A failed decode leaves the game as it was
+		pk::poker kept(3, 7, true);
+		kept.deal(2);
+		std::vector<unsigned char> before(pk::encoded_size(kept));
+		pk::encode(kept, before.data(), before.size());
+		for (std::size_t cut = 0; cut < buf.size(); cut += 1 + cut / 4) {
+			CHECK_THROWS(pk::decode(buf.data(), cut, kept), std::invalid_argument);
+		}
+		std::vector<unsigned char> after(pk::encoded_size(kept));
+		pk::encode(kept, after.data(), after.size());
+		CHECK(before == after);
+
+		std::ostringstream text;
+		text << game.card_pile();
+		pk::deck parsed;
+		pk::parse_deck(text.str(), parsed);
+		CHECK(parsed.size() == game.card_pile().size());
+		for (unsigned int i = 0; i < parsed.size() && i < game.card_pile().size(); ++i) {
+			CHECK(parsed[i] == game.card_pile()[i]);
+		}
+	}
+
+	unsigned char raw[8];
+	const pk::card_set cs = cards({0, 13, 26, 51});
+	pk::encode(cs, raw, sizeof raw);
+	pk::card_set back;
+	pk::decode(raw, sizeof raw, back);
+	CHECK(back == cs);
+	raw[7] |= 0x80;
+	CHECK_THROWS(pk::decode(raw, sizeof raw, back), std::invalid_argument);
+
+	// A decks count far above any real shoe is rejected before the game is touched
+	const unsigned char huge[]{pk::poker_format_version, 2, 0xFF, 0xFF, 0xFF, 0xFF, 0x0F, 0, 0, 0, 0};
+	pk::poker game(1, 3);
+	CHECK_THROWS(pk::decode(huge, sizeof huge, game), std::invalid_argument);
+	CHECK(game.player_count() == 3 && game.deck_count() == 1 && game.card_pile().size() == 52);
+	const unsigned char bad_card[]{pk::poker_format_version, 2, 1, 0, 1, 0x3F, 0, 0};
+	CHECK_THROWS(pk::decode(bad_card, sizeof bad_card, game), std::invalid_argument);
+	CHECK(game.player_count() == 3 && game.card_pile().size() == 52);
+	const unsigned char two[]{pk::poker_format_version, 2, 1, 0, 1, 0x31, 1, 0x02, 0};
+	CHECK(pk::decode(two, sizeof two, game) == sizeof two);
+	CHECK(game.player_count() == 2 && game.card_pile().size() == 1 && game[0].size() == 1 && game[1].size() == 0);
+}
+
+pk::equity_request three_way()
+{
+	pk::equity_request req;
+	req.hole = {cards({12, 11}), cards({23, 36}), cards({45, 46})};
+	req.trials = 400000;
+	req.seed = 5;
+	return req;
+}
+
+/** Sampling agrees with enumeration, and neither depends on the number of threads */
+void check_equity()
+{
+	pk::equity_request req = three_way();
+	req.mode = pk::equity_mode::enumerate;
+	req.threads = 1;
+	const pk::equity_result exact = pk::equity(req);
+	CHECK(exact.exact);
+	CHECK(exact.trials == 1370754);
+	req.threads = 4;
+	const pk::equity_result exact4 = pk::equity(req);
+	double total = 0;
+	for (std::size_t p = 0; p < exact.players.size(); ++p) {
+		CHECK(exact.players[p].win == exact4.players[p].win && std::fabs(exact.players[p].equity - exact4.players[p].equity) < 1e-12);
+		total += exact.players[p].equity;
+	}
+	CHECK(std::fabs(total - 1) < 1e-9);
+
+	req.mode = pk::equity_mode::monte_carlo;
+	req.threads = 1;
+	const pk::equity_result mc = pk::equity(req);
+	req.threads = 3;
+	const pk::equity_result mc3 = pk::equity(req);
+	CHECK(!mc.exact && mc.trials == req.trials);
+	for (std::size_t p = 0; p < mc.players.size(); ++p) {
+		// The counts are the same; the sums of shares may round apart
+		CHECK(mc.players[p].win == mc3.players[p].win && std::fabs(mc.players[p].equity - mc3.players[p].equity) < 1e-12);
+		CHECK(std::fabs(mc.players[p].equity - exact.players[p].equity) < 5 * mc.players[p].std_error);
+		CHECK(mc.players[p].ci_low <= mc.players[p].equity && mc.players[p].equity <= mc.players[p].ci_high);
+	}
+
+	// Early termination stops on a whole batch once the error is small
+	req.target_stderr = 0.002;
+	const pk::equity_result early = pk::equity(req);
+	CHECK(early.trials < req.trials && early.trials >= req.min_trials);
+
+	pk::equity_request bad = three_way();
+	bad.hole.push_back(cards({12}));
+	CHECK_THROWS(pk::equity(bad), std::invalid_argument);
+}
+
+/** Range equity: enumeration against a known value and against sampling, and the enumeration bound */
+void check_range()
+{
+	pk::range_equity_request req;
+	req.ranges = {pk::hand_range::parse("AA"), pk::hand_range::parse("KK")};
+	req.mode = pk::equity_mode::enumerate;
+	const pk::equity_result exact = pk::range_equity(req);
+	CHECK(exact.exact);
+	CHECK(std::fabs(exact.players[0].equity - 0.81946) < 5e-6);
+
+	req.ranges = {pk::hand_range::parse("QQ+, AKs"), pk::hand_range::parse("22+, A2s+")};
+	req.board = cards({0, 14, 28});
+	const pk::equity_result flop = pk::range_equity(req);
+	req.mode = pk::equity_mode::monte_carlo;
+	req.trials = 300000;
+	const pk::equity_result mc = pk::range_equity(req);
+	for (std::size_t p = 0; p < 2; ++p) {
+		CHECK(std::fabs(mc.players[p].equity - flop.players[p].equity) < 5 * mc.players[p].std_error + 1e-3);
+	}
+
+	pk::hand_range any = pk::hand_range::parse("22+, A2s+, K2s+, Q2s+, J2s+, T2s+, 92s+, 82s+, 72s+, 62s+, 52s+, 42s+, 32s, "
+		"A2o+, K2o+, Q2o+, J2o+, T2o+, 92o+, 82o+, 72o+, 62o+, 52o+, 42o+, 32o");
+	CHECK(any.size() == 1326);
+	req.ranges = {any, any, any, any};
+	req.board = pk::card_set{};
+	req.mode = pk::equity_mode::enumerate;
+	CHECK_THROWS(pk::range_equity(req), std::invalid_argument);
+
+	// Of the 36 indices of AA against AA, only the 6 without a common ace are dealt
+	req.ranges = {pk::hand_range::parse("AA"), pk::hand_range::parse("AA")};
+	req.board = cards({0, 14, 28});
+	const pk::equity_result split = pk::range_equity(req);
+	CHECK(split.exact && split.trials == 6 * 990);
+	CHECK(std::fabs(split.players[0].equity - 0.5) < 1e-12 && split.players[0].win == split.players[1].win);
+	req.ranges.push_back(pk::hand_range::parse("AA"));
+	CHECK_THROWS(pk::range_equity(req), std::invalid_argument);
+}
+
+/** Shards merged in any order give the counts of the whole request; other jobs and jokers are rejected */
+void check_shard()
+{
+	for (pk::equity_mode mode : {pk::equity_mode::monte_carlo, pk::equity_mode::enumerate}) {
+		pk::equity_request req = three_way();
+		req.mode = mode;
+		req.trials = 100000;
+		const pk::equity_result whole = pk::equity(req);
+		const pk::equity_job job = pk::equity_job::of(req);
+		std::vector<pk::shard_result> results;
+		for (pk::equity_shard const& s : job.shards(7)) {
+			std::vector<unsigned char> buf(pk::encoded_size(s));
+			pk::encode(s, buf.data(), buf.size());
+			pk::equity_shard sent;
+			pk::decode(buf.data(), buf.size(), sent);
+			const pk::shard_result r = pk::run_shard(sent, 2);
+			std::vector<unsigned char> out(pk::encoded_size(r));
+			pk::encode(r, out.data(), out.size());
+			pk::shard_result received;
+			pk::decode(out.data(), out.size(), received);
+			CHECK(received == r);
+			results.push_back(received);
+		}
+		pk::shard_result total;
+		for (std::size_t i : {3, 0, 6, 2, 5, 1, 4}) {
+			CHECK(!total.result(job).exact || i == 4);
+			total.merge(results[i]);
+		}
+		CHECK_THROWS(total.merge(results[2]), std::invalid_argument);
+		const pk::equity_result merged = total.result(job);
+		CHECK(merged.trials == whole.trials);
+		CHECK(merged.exact == whole.exact);
+		for (std::size_t p = 0; p < whole.players.size(); ++p) {
+			CHECK(merged.players[p].win == whole.players[p].win);
+			CHECK(merged.players[p].tie == whole.players[p].tie);
+			CHECK(std::fabs(merged.players[p].equity - whole.players[p].equity) < 1e-12);
+		}
+
+		pk::equity_job other = job;
+		other.seed += 1;
+		CHECK_THROWS(total.result(other), std::invalid_argument);
+		pk::shard_result foreign = pk::run_shard(other.shards(1)[0], 1);
+		CHECK_THROWS(total.merge(foreign), std::invalid_argument);
+	}
+
+	pk::equity_job job = pk::equity_job::of(three_way());
+	job.deck = pk::card_set::full(true);
+	std::vector<unsigned char> buf(pk::encoded_size(job));
+	pk::encode(job, buf.data(), buf.size());
+	pk::equity_job back;
+	CHECK_THROWS(pk::decode(buf.data(), buf.size(), back), std::invalid_argument);
+}
+
+#if __unix__ || __APPLE__
+/** Records keep their ids when an append fails, and a file which is not a history is rejected */
+void check_history()
+{
+	const std::string path = "check_history.bin";
+	const std::string junk = "check_history_junk.bin";
+	std::remove(path.c_str());
+	pk::poker game(1, 3), other(2, 3);
+	pk::xoshiro256ss generator(1);
+	{
+		pk::hand_history_writer writer(path, game, 2);
+		for (unsigned int i = 0; i < 5; ++i) {
+			game.shuffle(generator);
+			CHECK(writer.append(game) == 2 * i);
+			CHECK_THROWS(writer.append(other), std::invalid_argument);
+			game.deal(1);
+			CHECK(writer.append(game) == 2 * i + 1);
+		}
+	}
+	{
+		pk::hand_history_reader reader(path);
+		CHECK(reader.size() == 10);
+		pk::poker loaded;
+		reader.load(9, loaded);
+		std::vector<unsigned char> a(pk::encoded_size(game)), b(pk::encoded_size(loaded));
+		pk::encode(game, a.data(), a.size());
+		pk::encode(loaded, b.data(), b.size());
+		CHECK(a == b);
+	}
+	if (std::FILE *f = std::fopen(junk.c_str(), "wb")) {
+		const std::string bytes(128, 'x');
+		std::fwrite(bytes.data(), 1, bytes.size(), f);
+		std::fclose(f);
+	}
+	CHECK_THROWS(pk::hand_history_reader{junk}, std::invalid_argument);
+	std::remove(path.c_str());
+	std::remove(junk.c_str());
+}
+#endif // __unix__ || __APPLE__
+
+/** Every pile of a batch stays a permutation of the layout, including empty piles */
+void check_batch()
+{
+	pk::philox4x32 generator(2);
+	pk::poker_batch empty(4, 0, 2);
+	empty.shuffle(generator);
+	CHECK(empty.full_pile_size() == 0);
+
+	pk::poker_batch batch(64, 2, 4, true);
+	batch.shuffle(generator);
+	const unsigned int n = batch.full_pile_size();
+	std::vector<std::uint8_t> layout(batch.table_cards(0), batch.table_cards(0) + n);
+	std::sort(layout.begin(), layout.end());
+	for (std::size_t t = 0; t < batch.size(); ++t) {
+		std::vector<std::uint8_t> pile(batch.table_cards(t), batch.table_cards(t) + n);
+		std::sort(pile.begin(), pile.end());
+		CHECK(pile == layout);
+	}
+	batch.deal(5);
+	CHECK(batch.hand_size() == 5);
+	CHECK_THROWS(batch.deal(100), std::out_of_range);
+}
+
+/** A snapshot replays the shuffles of its engine, and refuses an engine of another type */
+void check_snapshot()
+{
+	pk::poker game(1, 4);
+	pk::xoshiro256ss generator(9);
+	pk::pcg64 other(9);
+	pk::poker_snapshot saved;
+	saved.save(game, generator);
+	game.shuffle(generator);
+	game.deal(3);
+	std::vector<unsigned char> first(pk::encoded_size(game));
+	pk::encode(game, first.data(), first.size());
+
+	pk::poker replay(2, 2);
+	CHECK_THROWS(saved.restore(replay, other), std::invalid_argument);
+	saved.restore(replay, generator);
+	replay.shuffle(generator);
+	replay.deal(3);
+	std::vector<unsigned char> second(pk::encoded_size(replay));
+	pk::encode(replay, second.data(), second.size());
+	CHECK(first == second);
+
+	pk::shuffle_log log(4);
+	pk::poker a, b;
+	log.shuffle(a);
+	log.shuffle(a);
+	pk::shuffle(b, log.shuffles()[0]);
+	pk::shuffle(b, log.shuffles()[1]);
+	CHECK(a.card_pile().size() == b.card_pile().size());
+	for (unsigned int i = 0; i < a.card_pile().size(); ++i) {
+		CHECK(a.card_pile()[i] == b.card_pile()[i]);
+	}
+}
+
+/** The engines against the published known-answer vectors */
+void check_rng()
+{
+	// pcg-c check-pcg64, pcg64_srandom_r(&rng, 42, 54)
+	pk::pcg64 pcg(42, 54);
+	const std::uint64_t pcg_ref[6]{0x86b1da1d72062b68ull, 0x1304aa46c9853d39ull, 0xa3670e9e0dd50358ull,
+		0xf9090e529a7dae00ull, 0xc85b9fd837996f2cull, 0x606121f8e3919196ull};
+	for (std::uint64_t v : pcg_ref) {
+		CHECK(pcg() == v);
+	}
+
+	// Random123 kat_vectors, philox4x32 10; the counter is (block_no, stream) low word first
+	struct philox_kat {
+		std::uint32_t ctr[4], key[2], out[4];
+	};
+	const philox_kat philox_ref[3]{
+		{{0, 0, 0, 0}, {0, 0}, {0x6627e8d5, 0xe169c58d, 0xbc57ac4c, 0x9b00dbd8}},
+		{{0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff}, {0xffffffff, 0xffffffff}, {0x408f276d, 0x41c83b0e, 0xa20bc7c6, 0x6d5451fd}},
+		{{0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344}, {0xa4093822, 0x299f31d0}, {0xd16cfe09, 0x94fdcceb, 0x5001e420, 0x24126ea1}},
+	};
+	for (philox_kat const& k : philox_ref) {
+		std::uint32_t out[4];
+		pk::philox4x32::block(k.key[0], k.key[1], static_cast<std::uint64_t>(k.ctr[1]) << 32 | k.ctr[0],
+			static_cast<std::uint64_t>(k.ctr[3]) << 32 | k.ctr[2], out);
+		CHECK(std::equal(out, out + 4, k.out));
+	}
+	pk::philox4x32 philox(0, 0);
+	for (std::uint32_t v : philox_ref[0].out) {
+		CHECK(philox() == v);
+	}
+
+	// splitmix64.c from seed 0, and xoshiro256** from the state {1, 2, 3, 4}
+	std::uint64_t x = 0;
+	const std::uint64_t splitmix_ref[4]{0xe220a8397b1dcdafull, 0x6e789e6aa1b965f4ull, 0x06c45d188009454full, 0xf88bb8a8724c81ecull};
+	for (std::uint64_t v : splitmix_ref) {
+		CHECK(pk::splitmix64(x) == v);
+	}
+	static_assert(sizeof(pk::xoshiro256ss) == 32, "The state of xoshiro256** is 4 words");
+	pk::xoshiro256ss xoshiro;
+	const std::uint64_t state[4]{1, 2, 3, 4};
+	std::memcpy(static_cast<void *>(&xoshiro), state, sizeof state);
+	const std::uint64_t xoshiro_ref[10]{11520, 0, 1509978240, 1215971899390074240ull, 1216172134540287360ull,
+		607988272756665600ull, 16172922978634559625ull, 8476171486693032832ull, 10595114339597558777ull, 2904607092377533576ull};
+	for (std::uint64_t v : xoshiro_ref) {
+		CHECK(xoshiro() == v);
+	}
+
+	// Seeding by splitmix64 gives the same engine as its outputs
+	pk::xoshiro256ss seeded(0), by_hand;
+	std::memcpy(static_cast<void *>(&by_hand), splitmix_ref, sizeof splitmix_ref);
+	CHECK(seeded == by_hand);
+}
+
+/** Every batch kernel the CPU runs against evaluate() on random 5, 6 and 7 card hands */
+void check_batch_evaluate()
+{
+	pk::xoshiro256ss generator(5);
+	pk::hand_batch_buffer hands;
+	std::vector<pk::hand_strength> ref;
+	// Not a multiple of the block, so that the padded tail is covered too
+	for (unsigned int n = 0; n < 3001; ++n) {
+		std::uint64_t m = 0;
+		while (static_cast<unsigned int>(__builtin_popcountll(m)) < 5 + n % 3) {
+			m |= card_bit(static_cast<unsigned int>(generator() % 52));
+		}
+		hands.push_back(pk::card_set{m});
+		ref.push_back(pk::evaluate(pk::card_set{m}));
+	}
+	std::vector<void (*)(pk::hand_batch const&, pk::hand_strength *)> kernels{&pk::detail::batch_scalar};
+#if POKER_BATCH_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		kernels.push_back(&pk::detail::batch_scalar_avx2);
+	}
+	if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")) {
+		kernels.push_back(&pk::detail::batch_scalar_avx512);
+	}
+#endif // POKER_BATCH_X86
+	kernels.push_back(pk::detail::batch_kernel().kernel);
+	for (auto kernel : kernels) {
+		std::vector<pk::hand_strength> out(ref.size());
+		kernel(hands.view(), out.data());
+		CHECK(out == ref);
+	}
+	std::vector<pk::hand_strength> out(ref.size());
+	pk::evaluate(hands.view(), out.data());
+	CHECK(out == ref);
+}
+
+/** Dealing into fixed hands, their capacity, and reset() restoring the pile */
+void check_fixed_hand()
+{
+	pk::poker game(1, 4);
+	const pk::deck initial = game.card_pile();
+	pk::fixed_hand<5> hands[4];
+	game.deal(2, hands);
+	CHECK(game.card_pile().size() == 52 - 8);
+	for (auto const& hd : hands) {
+		CHECK(hd.size() == 2);
+	}
+	CHECK(hands[0][0] == initial[51]);
+	CHECK(hands[1][0] == initial[50]);
+	CHECK(game.draw(hands[0]) == initial[43]);
+	// Hand 0 has no room for 3 more, so nothing is dealt
+	CHECK_THROWS(game.deal(3, hands), std::length_error);
+	CHECK(game.card_pile().size() == 52 - 9);
+	CHECK(hands[1].size() == 2);
+	game.deal(2, hands);
+	CHECK(hands[0].size() == 5);
+	CHECK_THROWS(game.draw(hands[0]), std::length_error);
+	CHECK(game.card_pile().size() == 52 - 17);
+
+	pk::fixed_hand<16> big[4];
+	CHECK_THROWS(game.deal(9, big), std::out_of_range);
+	game.deal(8, big);
+	game.draw(big[0]);
+	game.draw(big[0]);
+	game.draw(big[0]);
+	CHECK(game.card_pile().empty());
+	CHECK_THROWS(game.draw(big[0]), std::out_of_range);
+
+	game.reset();
+	game.deal(3);
+	game.reset();
+	CHECK(game.card_pile().size() == 52);
+	for (unsigned int i = 0; i < 52; ++i) {
+		CHECK(game.card_pile()[i] == initial[i]);
+	}
+	for (unsigned int p = 0; p < 4; ++p) {
+		CHECK(game[p].size() == 0);
+	}
+	hands[2].clear();
+	CHECK(hands[2].empty());
+	CHECK(hands[2].capacity() == 5);
+}
+
+/** A memory resource that counts what goes through it */
+class counting_resource : public std::pmr::memory_resource {
+public:
+	std::size_t allocations = 0;
+	std::size_t live = 0;
+
+private:
+	void *do_allocate(std::size_t bytes, std::size_t align) override
+	{
+		++allocations;
+		live += bytes;
+		return std::pmr::new_delete_resource()->allocate(bytes, align);
+	}
+
+	void do_deallocate(void *p, std::size_t bytes, std::size_t align) override
+	{
+		live -= bytes;
+		std::pmr::new_delete_resource()->deallocate(p, bytes, align);
+	}
+
+	bool do_is_equal(std::pmr::memory_resource const& other) const noexcept override
+	{
+		return this == &other;
+	}
+};
+
+/** A game on a memory resource takes the pile and every hand from it, and nothing from the default */
+void check_pmr()
+{
+	counting_resource table, fallback;
+	std::pmr::memory_resource *previous = std::pmr::set_default_resource(&fallback);
+	{
+		pk::poker game(2, 6, true, &table);
+		CHECK(table.allocations > 0);
+		pk::xoshiro256ss generator(4);
+		game.shuffle(generator);
+		game.deal(5);
+		game.draw(0);
+		game.reset();
+		game.deal(5);
+		CHECK(game[0].get_allocator().resource() == &table);
+		CHECK(game.card_pile().get_allocator().resource() == &table);
+
+		pk::deck copy(game[1], &table);
+		CHECK(copy.size() == 5);
+		CHECK(copy.get_allocator().resource() == &table);
+		const std::size_t before = table.allocations;
+		pk::deck moved(std::move(copy), &table);
+		CHECK(table.allocations == before);
+		CHECK(moved.size() == 5);
+	}
+	std::pmr::set_default_resource(previous);
+	CHECK(fallback.allocations == 0);
+	CHECK(table.live == 0);
+}
+
+/** A tracked hand matches evaluate() after random adds and removes, and refuses what it does not hold */
+void check_tracked_hand()
+{
+	pk::xoshiro256ss generator(16);
+	pk::tracked_hand th;
+	std::vector<pk::card> held;
+	for (unsigned int step = 0; step < 20000; ++step) {
+		if (held.size() < 5 || (held.size() < 7 && generator() % 2 == 0)) {
+			pk::card c;
+			do {
+				c = pk::card{static_cast<unsigned short>(generator() % 4), static_cast<unsigned short>(1 + generator() % 13)};
+			} while (std::find(held.begin(), held.end(), c) != held.end());
+			th.add(c);
+			held.push_back(c);
+		} else {
+			const std::size_t i = static_cast<std::size_t>(generator() % held.size());
+			th.remove(held[i]);
+			held.erase(held.begin() + static_cast<std::ptrdiff_t>(i));
+		}
+		pk::card_set cs;
+		for (pk::card const& c : held) {
+			cs.insert(c);
+		}
+		CHECK(th.size() == held.size());
+		for (int suit = pk::CLUB; suit <= pk::SPADE; ++suit) {
+			CHECK(th.suit_mask(suit) == cs.suit_mask(suit));
+		}
+		const unsigned int number = 1 + static_cast<unsigned int>(generator() % 13);
+		CHECK(th.rank_count(number) == static_cast<unsigned int>(std::count_if(held.begin(), held.end(),
+			[number](pk::card const& c) { return c.number == number; })));
+		if (held.size() >= 5) {
+			CHECK(th.strength() == pk::evaluate(cs));
+		}
+	}
+
+	pk::tracked_hand small;
+	const pk::card ace{pk::SPADE, 1}, joker{1, 14};
+	small.add(ace);
+	small.add(joker);
+	CHECK(small.rank_count(1) == 1);
+	CHECK(small.rank_count(14) == 1);
+	CHECK_THROWS(small.remove(pk::card{pk::HEART, 1}), std::invalid_argument);
+	CHECK_THROWS(small.remove(pk::card{pk::SPADE, 0}), std::invalid_argument);
+	CHECK_THROWS(small.add(pk::card{pk::SPADE, 15}), std::invalid_argument);
+	CHECK_THROWS(small.rank_count(0), std::invalid_argument);
+	CHECK(small.size() == 2);
+	small.remove(joker);
+	CHECK_THROWS(small.remove(joker), std::invalid_argument);
+	small.remove(ace);
+	CHECK(small.size() == 0 && small.rank_count(1) == 0 && small.suit_mask(pk::SPADE) == 0);
+}
+
+/** An indexed deck against a plain deck: stable removes keep the same order, unordered ones the same cards */
+void check_indexed_deck()
+{
+	pk::xoshiro256ss generator(17);
+	pk::poker shoe(3, 1, true);
+	shoe.shuffle(generator);
+	pk::deck plain = shoe.card_pile();
+	pk::indexed_deck indexed{plain};
+	auto same_counts = [&] {
+		for (unsigned short suit = 0; suit < 4; ++suit) {
+			for (unsigned short number = 0; number < 16; ++number) {
+				const pk::card c{suit, number};
+				if (indexed.count(c) != plain.count(c) || indexed.contains(c) != plain.contains(c)) {
+					return false;
+				}
+			}
+		}
+		return indexed.size() == plain.size();
+	};
+	for (unsigned int step = 0; step < 400 && !plain.empty(); ++step) {
+		const pk::card c = plain[static_cast<unsigned int>(generator() % plain.size())];
+		switch (generator() % 4) {
+		case 0:
+			plain.remove(c, pk::deck::remove_mode::stable);
+			indexed.remove(c, pk::deck::remove_mode::stable);
+			break;
+		case 1:
+			plain.push_back(c);
+			indexed.push_back(c);
+			break;
+		case 2:
+			plain.pop_back();
+			indexed.pop_back();
+			break;
+		default:
+			// The copies of c may be taken from different positions, so the cards are compared as a multiset after
+			indexed.remove(c, pk::deck::remove_mode::unordered);
+			plain.remove(c, pk::deck::remove_mode::unordered);
+			CHECK(same_counts());
+			plain = indexed.cards();
+			continue;
+		}
+		CHECK(same_counts());
+		bool same_order = true;
+		for (unsigned int i = 0; i < plain.size() && i < indexed.size(); ++i) {
+			same_order = same_order && plain[i] == indexed[i];
+		}
+		CHECK(same_order);
+	}
+	CHECK_THROWS(indexed.remove(pk::card{0, 15}), std::invalid_argument);
+
+	// An unordered remove of a deck moves the last card into the hole
+	pk::deck dk;
+	dk.push_back(pk::card{pk::SPADE, 1});
+	dk.push_back(pk::card{pk::HEART, 2});
+	dk.push_back(pk::card{pk::CLUB, 3});
+	dk.remove(pk::card{pk::SPADE, 1}, pk::deck::remove_mode::unordered);
+	CHECK(dk.size() == 2 && dk[0] == (pk::card{pk::CLUB, 3}) && dk[1] == (pk::card{pk::HEART, 2}));
+	CHECK_THROWS(dk.remove(pk::card{pk::SPADE, 1}, pk::deck::remove_mode::unordered), std::invalid_argument);
+}
+
+/** The probes count each call of their operation, on every thread, and call the hooks; with no PK_INSTRUMENT they count nothing */
+void check_instrument()
+{
+	const pk::probe_counters before = pk::instrument_snapshot();
+	const pk::probe_counters thread_before = pk::instrument_thread_snapshot();
+	std::uint64_t hooked[2]{};
+	auto on_begin = [](pk::probe, void *context) { ++static_cast<std::uint64_t *>(context)[0]; };
+	auto on_end = [](pk::probe, std::uint64_t, void *context) { ++static_cast<std::uint64_t *>(context)[1]; };
+	const pk::probe_hooks hooks{on_begin, on_end, hooked};
+	pk::set_probe_hooks(&hooks);
+
+	pk::poker game(1, 4);
+	pk::xoshiro256ss generator(20);
+	game.shuffle(generator);
+	game.deal(2);
+	game.draw(0);
+	game.draw(1);
+	game.play(0, game[0][0]);
+	game[1].sort();
+	pk::evaluate(cards({0, 1, 2, 3, 4}));
+	pk::hand_batch_buffer hands;
+	hands.push_back(cards({0, 14, 28, 42, 51}));
+	pk::hand_strength out[1];
+	pk::evaluate(hands.view(), out);
+	std::thread other([] {
+		for (unsigned int i = 0; i < 3; ++i) {
+			pk::evaluate(cards({5, 6, 7, 8, 9, 10, 11}));
+		}
+	});
+	other.join();
+	pk::set_probe_hooks(nullptr);
+
+	const pk::probe_counters spent = pk::instrument_snapshot() - before;
+	const pk::probe_counters mine = pk::instrument_thread_snapshot() - thread_before;
+#if PK_INSTRUMENT
+	const std::uint64_t calls[pk::probe_count]{1, 1, 2, 1, 1, 4, 1};
+	std::uint64_t total = 0;
+	for (std::size_t i = 0; i < pk::probe_count; ++i) {
+		CHECK(spent.calls[i] == calls[i]);
+		total += calls[i];
+	}
+	// The finished thread's counts are kept in the total, but not in the snapshot of this thread
+	CHECK(mine.calls[pk::probe_index(pk::probe::evaluate)] == 1);
+	CHECK(spent.ticks[pk::probe_index(pk::probe::shuffle)] > 0);
+	CHECK(hooked[0] == total && hooked[1] == total);
+#else
+	for (std::size_t i = 0; i < pk::probe_count; ++i) {
+		CHECK(spent.calls[i] == 0 && spent.ticks[i] == 0 && mine.calls[i] == 0);
+	}
+	CHECK(hooked[0] == 0 && hooked[1] == 0);
+#endif // PK_INSTRUMENT
+}
+
+/** Commands posted from many threads to tables on every shard run in order per poster, errors reach their caller, and shutdown drains the queues */
+void check_table_service()
+{
+	constexpr unsigned int tables = 16, posters = 4, posts = 500;
+	std::vector<std::vector<std::pair<unsigned int, unsigned int>>> logs(tables);
+	std::atomic<unsigned int> errors{0}, ran{0};
+	{
+		pk::table_service_options opt;
+		opt.shards = 4;
+		opt.queue_capacity = 64;
+		opt.on_error = [&errors](pk::table_id, std::exception_ptr) { ++errors; };
+		pk::table_service service{opt};
+		std::vector<pk::table_id> ids;
+		for (unsigned int t = 0; t < tables; ++t) {
+			ids.push_back(service.create_table(1, 4));
+		}
+		CHECK(ids[0].shard != ids[1].shard);
+
+		std::vector<std::thread> threads;
+		for (unsigned int p = 0; p < posters; ++p) {
+			threads.emplace_back([&, p] {
+				for (unsigned int i = 0; i < posts; ++i) {
+					const unsigned int t = (p + i) % tables;
+					// Each table is touched by its worker only, so its log needs no lock
+					service.submit(ids[t], [&logs, &ran, t, p, i](pk::table&) {
+						logs[t].emplace_back(p, i);
+						++ran;
+					});
+				}
+			});
+		}
+		for (auto& th : threads) {
+			th.join();
+		}
+
+		// A move-only function, and the exceptions of a command and of an erased table
+		auto owned = std::make_unique<unsigned int>(7);
+		CHECK(service.call(ids[0], [owned = std::move(owned)](pk::table&) { return *owned; }).get() == 7);
+		std::future<void> failed = service.call(ids[1], [](pk::table&) { throw std::logic_error("bad"); });
+		CHECK_THROWS(failed.get(), std::logic_error);
+		CHECK_THROWS(service.draw(ids[2], 9).get(), std::out_of_range);
+		service.erase_table(ids[3]);
+		CHECK_THROWS(service.draw(ids[3], 0).get(), std::out_of_range);
+		service.submit(ids[3], [](pk::table&) {});
+		service.submit(ids[4], [](pk::table&) { throw std::runtime_error("bad"); });
+		CHECK_THROWS(service.submit(pk::table_id{0, 1000}, [](pk::table&) {}), std::out_of_range);
+
+		// Still queued when the service is destroyed, and run before the workers stop
+		for (unsigned int i = 0; i < 1000; ++i) {
+			service.submit(ids[4 + i % (tables - 4)], [&ran](pk::table&) { ++ran; });
+		}
+	}
+	CHECK(ran == posters * posts + 1000);
+	CHECK(errors == 2);
+	std::size_t logged = 0;
+	for (auto const& log : logs) {
+		unsigned int next[posters]{};
+		bool ordered = true;
+		for (auto const& e : log) {
+			ordered = ordered && e.second >= next[e.first];
+			next[e.first] = e.second + 1;
+		}
+		CHECK(ordered);
+		logged += log.size();
+	}
+	CHECK(logged == posters * posts);
+}
+
+/** Lazy draws from a shoe: uniform cards, a full pile per pass, and the cut card */
+void check_shoe()
+{
+	pk::xoshiro256ss generator(24);
+	pk::poker shoe(8, 7);
+	CHECK(shoe.cut_card() == 0);
+	shoe.set_penetration(0.75);
+	CHECK(shoe.cut_card() == 416 - 312);
+	CHECK_THROWS(shoe.set_penetration(1.5), std::invalid_argument);
+	CHECK_THROWS(shoe.set_penetration(-0.1), std::invalid_argument);
+	CHECK(shoe.cut_card() == 104);
+	unsigned int rounds = 0;
+	while (!shoe.needs_reshuffle()) {
+		CHECK(shoe.card_pile().size() > shoe.cut_card());
+		shoe.deal(2, generator);
+		++rounds;
+	}
+	CHECK(rounds == (416 - 104 + 13) / 14);
+	CHECK(shoe.card_pile().size() <= 104 && shoe.card_pile().size() + 14 > 104);
+	shoe.reset();
+	CHECK(!shoe.needs_reshuffle() && shoe.card_pile().size() == 416);
+
+	// The first card drawn from a pile in order is any card of it, as often as any other
+	pk::poker game(1, 1);
+	unsigned int seen[52]{};
+	for (unsigned int n = 0; n < 52000; ++n) {
+		game.reset();
+		const pk::card c = game.draw(0, generator);
+		++seen[c.suit * 13 + c.number - 1];
+	}
+	CHECK(*std::min_element(std::begin(seen), std::end(seen)) > 850);
+	CHECK(*std::max_element(std::begin(seen), std::end(seen)) < 1150);
+
+	// Drawing the whole pile takes each card once
+	game.reset();
+	for (unsigned int n = 0; n < 52; ++n) {
+		game.draw(0, generator);
+	}
+	CHECK(pk::card_set{game[0]} == pk::card_set{pk::card_set::full_deck});
+	CHECK_THROWS(game.draw(0, generator), std::out_of_range);
+	CHECK_THROWS(game.draw(1, generator), std::out_of_range);
+	game.reset();
+	CHECK_THROWS(game.deal(53, generator), std::out_of_range);
+	CHECK(game.card_pile().size() == 52);
+}
+
+#if __unix__ || __APPLE__
+/** A written table maps back to its entries, and what it lacks is computed by live_equity() */
+void check_equity_table()
+{
+	const std::string path = "check_equity_table.pkt";
+	pk::equity_table_data data;
+	data.opponents = 2;
+	data.preflop_trials = 1;
+	data.flop_trials = 1;
+	data.seed = 28;
+	for (unsigned int i = 0; i < pk::detail::preflop_classes * data.opponents; ++i) {
+		data.preflop.push_back(static_cast<float>(i) / 1024);
+	}
+	data.flop.resize(pk::detail::flop_classes);
+	for (std::size_t i = 0; i < data.flop.size(); ++i) {
+		data.flop[i] = static_cast<float>(i % 4096) / 4096;
+	}
+	pk::write_equity_table(path, data);
+	data.preflop.pop_back();
+	CHECK_THROWS(pk::write_equity_table(path, data), std::invalid_argument);
+
+	pk::equity_table table(path);
+	CHECK(table.opponents() == 2 && table.has_flop());
+	table.live_trials = 2000;
+	// Every combo has a class, and the 169 classes are all used
+	std::vector<unsigned int> used(pk::detail::preflop_classes);
+	for (unsigned int b = 1; b < 52; ++b) {
+		for (unsigned int a = 0; a < b; ++a) {
+			const pk::card_set hole = cards({a, b});
+			CHECK(pk::detail::combo_of(hole) == b * (b - 1) / 2 + a);
+			++used[table.preflop_class(hole)];
+		}
+	}
+	CHECK(std::count(used.begin(), used.end(), 0u) == 0);
+	const pk::card_set hole = cards({12, 25}), flop = cards({0, 14, 28});
+	const unsigned int c = table.preflop_class(hole);
+	CHECK(table.preflop_class(cards({38, 51})) == c);
+	CHECK(table.preflop(hole, 1) == static_cast<float>(c * 2) / 1024);
+	CHECK(table.preflop(hole, 2) == static_cast<float>(c * 2 + 1) / 1024);
+	CHECK(table.preflop(hole, 3) == pk::live_equity(hole, pk::card_set{}, 3, 2000, pk::detail::entry_seed(28, 0, c * 64 + 3), 1));
+	const pk::card_set hand[2] = {hole, flop};
+	const std::uint64_t f = table.flop_indexer().index(hand, 2);
+	CHECK(table.flop(hole, flop) == static_cast<float>(f % 4096) / 4096);
+	CHECK_THROWS(table.preflop(cards({12}), 1), std::invalid_argument);
+
+	// Without a file every lookup is computed
+	pk::equity_table none;
+	none.live_trials = 2000;
+	CHECK(none.opponents() == 0 && !none.has_flop());
+	CHECK(none.preflop(hole, 1) == pk::live_equity(hole, pk::card_set{}, 1, 2000, pk::detail::entry_seed(0, 0, c * 64 + 1), 1));
+	CHECK(none.flop(hole, flop) == pk::live_equity(hole, flop, 1, 2000, pk::detail::entry_seed(0, 1, f), 1));
+	const double aces = none.preflop(cards({12, 25}), 1);
+	CHECK(aces > 0.82 && aces < 0.88);
+
+	std::FILE *junk = std::fopen(path.c_str(), "wb");
+	std::fputs("not a table", junk);
+	std::fclose(junk);
+	CHECK_THROWS(pk::equity_table{path}, std::invalid_argument);
+	std::remove(path.c_str());
+}
+#endif // __unix__ || __APPLE__
+
+struct check_case {
+	char const *name;
+	void (*run)();
+};
+
+const check_case checks[]{
+	{"evaluator", check_evaluator},
+	{"batch_evaluate", check_batch_evaluate},
+	{"tracked_hand", check_tracked_hand},
+	{"indexer", check_indexer},
+	{"sort", check_sort},
+	{"fixed_hand", check_fixed_hand},
+	{"shoe", check_shoe},
+	{"pmr", check_pmr},
+	{"indexed_deck", check_indexed_deck},
+	{"serialize", check_serialize},
+	{"equity", check_equity},
+	{"range", check_range},
+	{"shard", check_shard},
+#if __unix__ || __APPLE__
+	{"history", check_history},
+	{"equity_table", check_equity_table},
+#endif // __unix__ || __APPLE__
+	{"batch", check_batch},
+	{"table_service", check_table_service},
+	{"snapshot", check_snapshot},
+	{"rng", check_rng},
+	{"instrument", check_instrument},
+};
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+	unsigned int run = 0;
+	for (check_case const& c : checks) {
+		bool wanted = argc < 2;
+		for (int i = 1; i < argc; ++i) {
+			wanted = wanted || std::strcmp(argv[i], c.name) == 0;
+		}
+		if (!wanted) {
+			continue;
+		}
+		const unsigned int before = failures;
+		std::printf("%s\n", c.name);
+		std::fflush(stdout);
+		try {
+			c.run();
+		} catch (std::exception const& e) {
+			std::printf("    exception: %s\n", e.what());
+			++failures;
+		}
+		std::printf("%s: %s\n", c.name, failures == before ? "ok" : "FAILED");
+		++run;
+	}
+	if (run == 0) {
+		std::printf("No such check\n");
+		return 1;
+	}
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,602 @@
+/* equity.h Copyright 2019, 2023 TNPLR
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef EQUITY_H_
+#define EQUITY_H_
+
+#include "poker.h"
+#include "rng.h"
+#include "evaluator.h"
+
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+/*
+ * Texas Hold'em equity calculator
+ * E.g.
+ *     pk::equity_request req;
+ *     req.hole = {pk::card_set{game[0]}, pk::card_set{game[1]}};
+ *     req.target_stderr = 0.001;
+ *     pk::equity_result res = pk::equity(req);
+ *     std::cout << res.players[0].equity;
+ *
+ * Trials are run in batches, and batch b draws its boards from
+ * philox4x32(seed, b), starting from the same deck, so a batch gives the same boards
+ * whichever worker runs it; sample_batch() is that kernel.
+ * The batches are split into one index range per worker; a worker which runs
+ * out of batches steals half of the range of another worker.
+ *
+ * When few boards are left, every board is enumerated instead. The boards are the
+ * k-subsets of the remaining deck in colex order, indexed by the combinatorial number
+ * system, so a range of boards is a range of indices and needs no allocation.
+ * The remaining deck may be taken from a game in progress:
+ *     req.deck = pk::card_set{game.card_pile()};
+ */
+namespace pk {
+
+/** This enumerator is the mode of an equity calculation */
+enum class equity_mode {
+	automatic, /**< Enumerate when there are at most enumerate_limit boards, otherwise sample */
+	monte_carlo, /**< Sample boards */
+	enumerate, /**< Enumerate every board */
+};
+
+/** The input of an equity calculation */
+struct equity_request {
+	std::vector<card_set> hole; /**< Hole cards of each player, at most 2 per player */
+	card_set board; /**< Known board cards, at most 5 */
+	card_set dead; /**< Cards known to be out of the deck */
+	card_set deck = card_set::full(); /**< The cards boards are drawn from. Hole, board and dead cards are removed from it. */
+	equity_mode mode = equity_mode::automatic; /**< The mode of calculation */
+	std::uint64_t enumerate_limit = 2000000; /**< The largest number of boards enumerated in automatic mode */
+	std::uint64_t trials = 1000000; /**< The maximum number of sampled boards */
+	std::uint64_t min_trials = 10000; /**< The number of boards to sample before early termination is considered */
+	double target_stderr = 0; /**< Stop once the standard error of every equity is below this. 0 never stops early. */
+	double confidence_z = 1.96; /**< The z-score of the confidence interval. Default to 95%. */
+	unsigned int threads = 0; /**< The number of workers. 0 is one per hardware thread. */
+	std::uint64_t seed = 0; /**< The seed of the sampled boards */
+};
+
+/** The equity of one player */
+struct player_equity {
+	double win; /**< The fraction of boards won alone */
+	double tie; /**< The fraction of boards tied for the best hand */
+	double loss; /**< The fraction of boards lost */
+	double equity; /**< The expected share of the pot (a tie among k players is a share of 1/k) */
+	double std_error; /**< The standard error of equity */
+	double ci_low; /**< The lower bound of the confidence interval of equity */
+	double ci_high; /**< The upper bound of the confidence interval of equity */
+};
+
+/** The output of an equity calculation */
+struct equity_result {
+	std::vector<player_equity> players; /**< The equity of each player, in the order of equity_request::hole */
+	std::uint64_t trials = 0; /**< The number of boards evaluated */
+	bool exact = false; /**< Whether every board was enumerated */
+};
+
+namespace detail {
+/** The number of boards in a batch */
+constexpr std::uint32_t equity_batch = 1024;
+
+/**
+ * Index ranges of workers with work stealing
+ * Each worker owns a [begin, end) range packed into one atomic word. The owner takes
+ * indices from the front, and a thief takes the back half, both with a single CAS.
+ */
+class work_ranges {
+public:
+	/** Split [0, count) evenly over the workers */
+	work_ranges(unsigned int workers, std::uint32_t count) : slots(workers)
+	{
+		for (unsigned int i = 0; i < workers; ++i) {
+			std::uint32_t begin = static_cast<std::uint32_t>(static_cast<std::uint64_t>(count) * i / workers);
+			std::uint32_t end = static_cast<std::uint32_t>(static_cast<std::uint64_t>(count) * (i + 1) / workers);
+			slots[i].range.store(pack(begin, end), std::memory_order_relaxed);
+		}
+	}
+
+	/** Take the next index of a worker, stealing from the others when its own range is empty
+	 * @param worker The worker number
+	 * @param index The index taken
+	 * @return Return false if no index is left
+	 */
+	bool next(unsigned int worker, std::uint32_t& index)
+	{
+		std::atomic<std::uint64_t>& own = slots[worker].range;
+		std::uint64_t r = own.load(std::memory_order_relaxed);
+		while (begin_of(r) < end_of(r)) {
+			if (own.compare_exchange_weak(r, pack(begin_of(r) + 1, end_of(r)), std::memory_order_relaxed)) {
+				index = begin_of(r);
+				return true;
+			}
+		}
+		const unsigned int n = static_cast<unsigned int>(slots.size());
+		for (unsigned int k = 1; k < n; ++k) {
+			std::atomic<std::uint64_t>& victim = slots[(worker + k) % n].range;
+			std::uint64_t v = victim.load(std::memory_order_relaxed);
+			while (begin_of(v) < end_of(v)) {
+				std::uint32_t mid = begin_of(v) + (end_of(v) - begin_of(v)) / 2;
+				if (victim.compare_exchange_weak(v, pack(begin_of(v), mid), std::memory_order_relaxed)) {
+					own.store(pack(mid + 1, end_of(v)), std::memory_order_relaxed);
+					index = mid;
+					return true;
+				}
+			}
+		}
+		return false;
+	}
+
+private:
+	static inline std::uint64_t pack(std::uint32_t begin, std::uint32_t end)
+	{
+		return static_cast<std::uint64_t>(begin) << 32 | end;
+	}
+	static inline std::uint32_t begin_of(std::uint64_t r) { return static_cast<std::uint32_t>(r >> 32); }
+	static inline std::uint32_t end_of(std::uint64_t r) { return static_cast<std::uint32_t>(r); }
+
+	struct alignas(64) slot {
+		std::atomic<std::uint64_t> range;
+	};
+	std::vector<slot> slots; /**< The range of each worker, one cache line each */
+};
+
+/** @return C(n, k), or 0 if k > n */
+inline std::uint64_t binomial(unsigned int n, unsigned int k)
+{
+	if (k > n) {
+		return 0;
+	}
+	std::uint64_t r = 1;
+	for (unsigned int i = 1; i <= k; ++i) {
+		r = r * (n - k + i) / i;
+	}
+	return r;
+}
+
+/**
+ * k-subsets of [0, n) in colex order
+ * The subset of index r is the c_1 < ... < c_k with C(c_1, 1) + ... + C(c_k, k) = r.
+ */
+class colex_subset {
+public:
+	/** Start at the subset of an index
+	 * @param n The size of the set, at most 64
+	 * @param k The size of subsets, at most 5
+	 * @param index The index of the first subset
+	 */
+	colex_subset(unsigned int n, unsigned int k, std::uint64_t index) : k{k}
+	{
+		for (unsigned int i = k; i > 0; --i) {
+			unsigned int c = i - 1;
+			while (c + 1 < n && binomial(c + 1, i) <= index) {
+				++c;
+			}
+			index -= binomial(c, i);
+			elem[i - 1] = c;
+		}
+	}
+
+	/** @return The ith element of the subset, in ascending order */
+	inline unsigned int operator[](unsigned int i) const
+	{
+		return elem[i];
+	}
+
+	/** Move to the next subset in colex order */
+	inline void next()
+	{
+		unsigned int i = 0;
+		while (i + 1 < k && elem[i] + 1 == elem[i + 1]) {
+			elem[i] = i;
+			++i;
+		}
+		if (i < k) {
+			++elem[i];
+		}
+	}
+
+private:
+	unsigned int k;
+	unsigned int elem[5];
+};
+
+/** The counts of one player */
+struct equity_tally {
+	std::uint64_t win = 0;
+	std::uint64_t tie = 0;
+	double share = 0;
+	double share_sq = 0;
+};
+
+/** The counts of one worker, published for early termination */
+struct alignas(64) equity_progress {
+	std::atomic<std::uint64_t> trials{0};
+	std::vector<std::atomic<double>> share;
+	std::vector<std::atomic<double>> share_sq;
+};
+
+/** Throw if the cards of a request overlap or do not fit a hand of Hold'em */
+inline void check_request(equity_request const& req)
+{
+	if (req.hole.empty()) {
+		throw std::invalid_argument("At least one player is needed");
+	}
+	if (req.board.size() > 5) {
+		throw std::invalid_argument("The board has more than 5 cards");
+	}
+	card_set seen = req.board;
+	if ((seen & req.dead) != card_set{}) {
+		throw std::invalid_argument("A card is both on the board and dead");
+	}
+	seen |= req.dead;
+	for (card_set h : req.hole) {
+		if (h.size() > 2) {
+			throw std::invalid_argument("A player has more than 2 hole cards");
+		}
+		if ((seen & h) != card_set{}) {
+			throw std::invalid_argument("A card is held twice");
+		}
+		seen |= h;
+	}
+	if ((seen & card_set{card_set::joker_mask}) != card_set{}) {
+		throw std::invalid_argument("Jokers are not used in Hold'em");
+	}
+}
+
+/** Score one board and add it to the counts of every player
+ * @param hole Hole cards of each player
+ * @param board The complete board
+ * @param tally The counts of each player
+ * @param strength Scratch space of one strength per player
+ */
+inline void score_board(std::vector<card_set> const& hole, card_set board, equity_tally *tally, hand_strength *strength)
+{
+	const std::size_t n = hole.size();
+	hand_strength best = 0;
+	for (std::size_t p = 0; p < n; ++p) {
+		strength[p] = evaluate(hole[p] | board);
+		best = strength[p] > best ? strength[p] : best;
+	}
+	unsigned int winners = 0;
+	for (std::size_t p = 0; p < n; ++p) {
+		winners += strength[p] == best;
+	}
+	const double share = 1.0 / winners;
+	for (std::size_t p = 0; p < n; ++p) {
+		if (strength[p] == best) {
+			if (winners == 1) {
+				++tally[p].win;
+			} else {
+				++tally[p].tie;
+			}
+			tally[p].share += share;
+			tally[p].share_sq += share * share;
+		}
+	}
+}
+
+/** The constants of the sampled boards of a request, shared by every worker */
+struct sample_plan {
+	std::uint64_t seed; /**< The seed of the batches */
+	std::uint64_t trials; /**< The number of boards of every batch together */
+	std::uint64_t board; /**< The mask of the known board cards */
+	unsigned int missing; /**< The number of board cards to draw */
+	unsigned int players; /**< The number of players */
+	unsigned int deck_size; /**< The number of cards boards are drawn from */
+	std::uint8_t deck[52]; /**< The card_set bit indices of those cards, ascending */
+};
+
+/** Score one board of card_set masks and add it to the counts of every player, see score_board() */
+inline void score_masks(std::uint64_t const *hole, unsigned int players, std::uint64_t board,
+	evaluator_tables const& t, equity_tally *tally, hand_strength *strength)
+{
+	hand_strength best = 0;
+	for (unsigned int p = 0; p < players; ++p) {
+		const std::uint64_t m = hole[p] | board;
+		strength[p] = evaluate_masks(m & 0x1FFF, m >> 16 & 0x1FFF, m >> 32 & 0x1FFF, m >> 48 & 0x1FFF, t);
+		best = strength[p] > best ? strength[p] : best;
+	}
+	unsigned int winners = 0;
+	for (unsigned int p = 0; p < players; ++p) {
+		winners += strength[p] == best;
+	}
+	const double share = 1.0 / winners;
+	for (unsigned int p = 0; p < players; ++p) {
+		if (strength[p] == best) {
+			if (winners == 1) {
+				++tally[p].win;
+			} else {
+				++tally[p].tie;
+			}
+			tally[p].share += share;
+			tally[p].share_sq += share * share;
+		}
+	}
+}
+
+/** Sample the boards of one batch
+ * @param plan The constants of the request
+ * @param b The batch
+ * @param score Called with the mask of every complete board
+ * @return The number of boards of the batch
+ */
+template <class Score>
+inline std::uint64_t sample_boards(sample_plan const& plan, std::uint32_t b, Score& score)
+{
+	std::uint8_t deck[52];
+	for (unsigned int i = 0; i < plan.deck_size; ++i) {
+		deck[i] = plan.deck[i];
+	}
+	philox4x32 generator(plan.seed, b);
+	const std::uint64_t first = static_cast<std::uint64_t>(b) * equity_batch;
+	const std::uint64_t count = plan.trials - first < equity_batch ? plan.trials - first : equity_batch;
+	for (std::uint64_t i = 0; i < count; ++i) {
+		// Partial Fisher-Yates: the last `missing` cards of the deck become the rest of the board
+		std::uint64_t board = plan.board;
+		for (unsigned int k = 0; k < plan.missing; ++k) {
+			const unsigned int top = plan.deck_size - 1 - k;
+			const unsigned int j = bounded_rand(generator, top + 1);
+			const std::uint8_t c = deck[j];
+			deck[j] = deck[top];
+			deck[top] = c;
+			board |= 1ull << c;
+		}
+		score(board);
+	}
+	return count;
+}
+
+/** Enumerate the boards of one batch: the k-subsets of the deck of indices [b * equity_batch, ...) in colex order
+ * @param plan The constants of the request; trials is the number of boards
+ * @param b The batch
+ * @param score Called with the mask of every complete board
+ * @return The number of boards of the batch
+ */
+template <class Score>
+inline std::uint64_t enumerate_boards(sample_plan const& plan, std::uint32_t b, Score&& score)
+{
+	const std::uint64_t first = static_cast<std::uint64_t>(b) * equity_batch;
+	const std::uint64_t count = std::min<std::uint64_t>(equity_batch, plan.trials - first);
+	colex_subset subset(plan.deck_size, plan.missing, first);
+	for (std::uint64_t i = 0; i < count; ++i, subset.next()) {
+		std::uint64_t board = plan.board;
+		for (unsigned int k = 0; k < plan.missing; ++k) {
+			board |= 1ull << plan.deck[subset[k]];
+		}
+		score(board);
+	}
+	return count;
+}
+
+/** Adds every board to the counts of every player, see score_masks() */
+struct tally_scorer {
+	std::uint64_t const *hole;
+	unsigned int players;
+	evaluator_tables const& t;
+	equity_tally *tally;
+	hand_strength *strength;
+
+	inline void operator()(std::uint64_t board)
+	{
+		score_masks(hole, players, board, t, tally, strength);
+	}
+};
+
+/** Sample the boards of one batch and add them to the counts of every player
+ * @param plan The constants of the request
+ * @param hole The hole card masks of each player
+ * @param b The batch
+ * @param t The lookup tables of the evaluator
+ * @param tally The counts of each player
+ * @param strength Scratch space of one strength per player
+ * @return The number of boards of the batch
+ */
+inline std::uint64_t sample_batch(sample_plan const& plan, std::uint64_t const *hole, std::uint32_t b,
+	evaluator_tables const& t, equity_tally *tally, hand_strength *strength)
+{
+	tally_scorer score{hole, plan.players, t, tally, strength};
+	return sample_boards(plan, b, score);
+}
+
+/** @return The standard error of a mean from the sum and the sum of squares */
+inline double std_error(double sum, double sum_sq, double n)
+{
+	if (n < 2) {
+		return 0;
+	}
+	double mean = sum / n;
+	double var = sum_sq / n - mean * mean;
+	return var > 0 ? std::sqrt(var / n) : 0;
+}
+
+/** @return The result from the counts of every player */
+inline equity_result make_result(std::vector<equity_tally> const& tally, std::uint64_t trials, double z)
+{
+	equity_result res;
+	res.trials = trials;
+	const double n = static_cast<double>(trials);
+	for (equity_tally const& t : tally) {
+		player_equity pe{};
+		if (trials) {
+			pe.win = t.win / n;
+			pe.tie = t.tie / n;
+			pe.loss = 1.0 - pe.win - pe.tie;
+			pe.equity = t.share / n;
+		}
+		pe.std_error = std_error(t.share, t.share_sq, n);
+		pe.ci_low = std::max(0.0, pe.equity - z * pe.std_error);
+		pe.ci_high = std::min(1.0, pe.equity + z * pe.std_error);
+		res.players.push_back(pe);
+	}
+	return res;
+}
+
+/** @return The number of workers for a request with a number of batches */
+inline unsigned int worker_count(unsigned int threads, std::uint64_t batches)
+{
+	if (threads == 0) {
+		threads = std::thread::hardware_concurrency();
+	}
+	if (threads == 0) {
+		threads = 1;
+	}
+	return static_cast<unsigned int>(std::min<std::uint64_t>(threads, batches ? batches : 1));
+}
+
+/** Run fn(worker) on a number of workers, the calling thread being worker 0 */
+template <class F>
+inline void run_workers(unsigned int workers, F&& fn)
+{
+	std::vector<std::thread> pool;
+	pool.reserve(workers - 1);
+	for (unsigned int w = 1; w < workers; ++w) {
+		pool.emplace_back(fn, w);
+	}
+	fn(0u);
+	for (std::thread& t : pool) {
+		t.join();
+	}
+}
+} // namespace detail
+
+/** Calculate the equity of every player over the rest of the board
+ * @param req The request
+ * @return The win/tie/loss fractions and the equity of each player
+ */
+inline equity_result equity(equity_request const& req)
+{
+	detail::check_request(req);
+	const std::size_t players = req.hole.size();
+	card_set known = req.board | req.dead;
+	for (card_set h : req.hole) {
+		known |= h;
+	}
+	const card_set rest = (req.deck & card_set::full()) - known;
+	const unsigned int missing = 5 - req.board.size();
+	if (rest.size() < missing) {
+		throw std::invalid_argument("Not enough cards left to complete the board");
+	}
+
+	const std::uint64_t boards = detail::binomial(rest.size(), missing);
+	const bool exact = req.mode == equity_mode::enumerate
+		|| (req.mode == equity_mode::automatic && boards <= req.enumerate_limit);
+	const std::uint64_t total = exact ? boards : req.trials;
+	const std::uint64_t batches = (total + detail::equity_batch - 1) / detail::equity_batch;
+	if (batches > 0xFFFFFFFFull) {
+		throw std::invalid_argument("Too many trials");
+	}
+	const bool early = !exact && req.target_stderr > 0;
+
+	detail::sample_plan plan{req.seed, total, req.board.mask(), missing, static_cast<unsigned int>(players), 0, {}};
+	for (std::uint64_t m = rest.mask(); m; m &= m - 1) {
+		plan.deck[plan.deck_size++] = static_cast<std::uint8_t>(detail::ctz64(m));
+	}
+	std::vector<std::uint64_t> hole(players);
+	for (std::size_t p = 0; p < players; ++p) {
+		hole[p] = req.hole[p].mask();
+	}
+	const unsigned int workers = detail::worker_count(req.threads, batches);
+	detail::work_ranges ranges(workers, static_cast<std::uint32_t>(batches));
+	std::vector<detail::equity_progress> progress(workers);
+	for (detail::equity_progress& p : progress) {
+		p.share = std::vector<std::atomic<double>>(players);
+		p.share_sq = std::vector<std::atomic<double>>(players);
+	}
+	std::vector<std::vector<detail::equity_tally>> tally(workers, std::vector<detail::equity_tally>(players));
+	std::vector<std::uint64_t> trials(workers, 0);
+	std::atomic<bool> stop{false};
+
+	auto worker = [&](unsigned int w) {
+		std::vector<hand_strength> strength(players);
+		std::vector<detail::equity_tally> local(players);
+		detail::equity_tally *t = local.data();
+		std::uint64_t done = 0;
+		std::uint32_t b;
+		unsigned int published = 0;
+		while (!stop.load(std::memory_order_relaxed) && ranges.next(w, b)) {
+			if (exact) {
+				done += detail::enumerate_boards(plan, b, [&](std::uint64_t board) {
+					detail::score_board(req.hole, card_set{board}, t, strength.data());
+				});
+			} else {
+				done += detail::sample_batch(plan, hole.data(), b, detail::tables(), t, strength.data());
+			}
+
+			if (!early) {
+				continue;
+			}
+			detail::equity_progress& own = progress[w];
+			for (std::size_t p = 0; p < players; ++p) {
+				own.share[p].store(t[p].share, std::memory_order_relaxed);
+				own.share_sq[p].store(t[p].share_sq, std::memory_order_relaxed);
+			}
+			own.trials.store(done, std::memory_order_relaxed);
+			if (++published % 4) {
+				continue;
+			}
+			// Every few batches, check whether the combined standard error is small enough
+			double n = 0;
+			for (detail::equity_progress const& p : progress) {
+				n += static_cast<double>(p.trials.load(std::memory_order_relaxed));
+			}
+			if (n < static_cast<double>(req.min_trials)) {
+				continue;
+			}
+			double worst = 0;
+			for (std::size_t p = 0; p < players; ++p) {
+				double sum = 0, sum_sq = 0;
+				for (detail::equity_progress const& q : progress) {
+					sum += q.share[p].load(std::memory_order_relaxed);
+					sum_sq += q.share_sq[p].load(std::memory_order_relaxed);
+				}
+				worst = std::max(worst, detail::std_error(sum, sum_sq, n));
+			}
+			if (worst < req.target_stderr) {
+				stop.store(true, std::memory_order_relaxed);
+			}
+		}
+		tally[w] = local;
+		trials[w] = done;
+	};
+	detail::run_workers(workers, worker);
+
+	std::vector<detail::equity_tally> sum(players);
+	std::uint64_t total_trials = 0;
+	for (unsigned int w = 0; w < workers; ++w) {
+		total_trials += trials[w];
+		for (std::size_t p = 0; p < players; ++p) {
+			sum[p].win += tally[w][p].win;
+			sum[p].tie += tally[w][p].tie;
+			sum[p].share += tally[w][p].share;
+			sum[p].share_sq += tally[w][p].share_sq;
+		}
+	}
+	equity_result res = detail::make_result(sum, total_trials, req.confidence_z);
+	if (exact) {
+		res.exact = true;
+		for (player_equity& pe : res.players) {
+			pe.std_error = 0;
+			pe.ci_low = pe.ci_high = pe.equity;
+		}
+	}
+	return res;
+}
+
+} // namespace pk
+#endif // EQUITY_H_
@@ -0,0 +1,398 @@
+/* equity_table.h Copyright 2019, 2023 TNPLR
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef EQUITY_TABLE_H_
+#define EQUITY_TABLE_H_
+
+#include "poker.h"
+#include "rng.h"
+#include "evaluator.h"
+#include "equity.h"
+#include "isomorphism.h"
+
+// The table is mapped with POSIX mmap, like history.h, which this header shares it with
+#if __unix__ || __APPLE__
+#include "history.h"
+#else
+#error "equity_table.h needs POSIX mmap"
+#endif // __unix__ || __APPLE__
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+
+/*
+ * Precomputed equity tables
+ * The equity of a hand against random opponents depends only on its suit-isomorphic
+ * class (see isomorphism.h), so it can be computed once per class:
+ *     preflop   169 classes, against 1 to N random opponents
+ *     flop      1286792 classes of hole cards and flop, against one random opponent
+ * The tool equity_table_gen writes a table file, which an equity_table maps at startup:
+ *     ./equity_table_gen --out=equity.pkt [--opponents=N] [--preflop-trials=T] [--flop-trials=T] [--seed=S]
+ *
+ *     pk::equity_table table("equity.pkt");
+ *     double e = table.preflop(hole, 3);    // a load, or live_equity() if the table lacks it
+ *     double f = table.flop(hole, flop);
+ *
+ * The file is in host byte order, which the header records:
+ *     header    64 bytes: "PKET", version, byte order mark, opponents, preflop and flop trials,
+ *               the number of flop entries (0 or 1286792), seed
+ *     preflop   169 * opponents float, class-major: entry class * opponents + (opponents - 1)
+ *     flop      float per flop class, in the order of hand_indexer::holdem() round 1
+ */
+namespace pk {
+
+namespace detail {
+constexpr char table_magic[4]{'P', 'K', 'E', 'T'};
+constexpr std::uint32_t table_version = 1;
+constexpr std::uint32_t table_byte_order = 0x01020304;
+constexpr std::size_t table_header_size = 64;
+constexpr std::uint32_t preflop_classes = 169;
+constexpr std::uint64_t flop_classes = 1286792;
+
+inline void put_u64(unsigned char *p, std::uint64_t v)
+{
+	put_u32(p, static_cast<std::uint32_t>(v));
+	put_u32(p + 4, static_cast<std::uint32_t>(v >> 32));
+}
+
+inline std::uint64_t get_u64(unsigned char const *p)
+{
+	return get_u32(p) | static_cast<std::uint64_t>(get_u32(p + 4)) << 32;
+}
+
+/** @return The seed of an entry of a round (0 preflop, 1 flop), so that every entry has its own samples */
+inline std::uint64_t entry_seed(std::uint64_t seed, unsigned int round, std::uint64_t entry)
+{
+	std::uint64_t x = seed ^ (entry * 2 + round) * 0xD1B54A32D192ED03ull;
+	return splitmix64(x);
+}
+
+/** @return The index of two different cards (bit indices of card_set) among the 1326 combos */
+inline unsigned int combo_of(card_set hole)
+{
+	const std::uint64_t m = hole.mask();
+	const unsigned int lo = ctz64(m), hi = 63 - clz64(m);
+	const unsigned int a = lo / 16 * 13 + lo % 16, b = hi / 16 * 13 + hi % 16;
+	return b * (b - 1) / 2 + a;
+}
+} // namespace detail
+
+/** Calculate the equity of hole cards against random opponents by sampling
+ * The samples are in philox batches like equity(), so the result depends on the number of threads only by rounding.
+ * @param hole The hole cards, 2 cards
+ * @param board Known board cards, at most 5
+ * @param opponents The number of random opponents, at least 1
+ * @param trials The number of samples
+ * @param seed The seed of the samples
+ * @param threads The number of workers. 0 is one per hardware thread. Default to 1.
+ * @return The expected share of the pot of hole
+ */
+inline double live_equity(card_set hole, card_set board, unsigned int opponents, std::uint64_t trials,
+	std::uint64_t seed, unsigned int threads = 1)
+{
+	if (hole.size() != 2 || board.size() > 5 || (hole & board) != card_set{}
+		|| ((hole | board).mask() & ~card_set::full_deck)) {
+		throw std::invalid_argument("Malformed hole cards or board");
+	}
+	const unsigned int missing = 5 - board.size();
+	const card_set rest = card_set::full() - hole - board;
+	if (opponents == 0 || rest.size() < 2 * opponents + missing) {
+		throw std::invalid_argument("Wrong number of opponents");
+	}
+	if (trials == 0) {
+		throw std::invalid_argument("At least one trial is needed");
+	}
+	const std::uint64_t batches = (trials + detail::equity_batch - 1) / detail::equity_batch;
+	if (batches > 0xFFFFFFFFull) {
+		throw std::invalid_argument("Too many trials");
+	}
+	const unsigned int workers = detail::worker_count(threads, batches);
+	detail::work_ranges ranges(workers, static_cast<std::uint32_t>(batches));
+	std::vector<double> share(workers, 0);
+
+	auto worker = [&](unsigned int w) {
+		std::uint8_t start[52], deck[52];
+		unsigned int deck_size = 0;
+		for (std::uint64_t m = rest.mask(); m; m &= m - 1) {
+			start[deck_size++] = static_cast<std::uint8_t>(detail::ctz64(m));
+		}
+		std::vector<card_set> holes(opponents + 1);
+		holes[0] = hole;
+		std::vector<hand_strength> strength(opponents + 1);
+		std::vector<detail::equity_tally> tally(opponents + 1);
+		std::uint32_t b;
+		while (ranges.next(w, b)) {
+			// Every batch starts from the same deck, so it depends only on its stream
+			std::memcpy(deck, start, deck_size);
+			philox4x32 generator(seed, b);
+			const std::uint64_t first = static_cast<std::uint64_t>(b) * detail::equity_batch;
+			const std::uint64_t count = std::min<std::uint64_t>(detail::equity_batch, trials - first);
+			for (std::uint64_t i = 0; i < count; ++i) {
+				// Partial Fisher-Yates: the last cards of the deck are the opponents and the rest of the board
+				unsigned int top = deck_size;
+				auto next = [&] {
+					--top;
+					std::swap(deck[top], deck[detail::bounded_rand(generator, top + 1)]);
+					return 1ull << deck[top];
+				};
+				for (unsigned int p = 1; p <= opponents; ++p) {
+					std::uint64_t h = next();
+					holes[p] = card_set{h | next()};
+				}
+				std::uint64_t full = board.mask();
+				for (unsigned int k = 0; k < missing; ++k) {
+					full |= next();
+				}
+				detail::score_board(holes, card_set{full}, tally.data(), strength.data());
+			}
+		}
+		share[w] = tally[0].share;
+	};
+	detail::run_workers(workers, worker);
+
+	double sum = 0;
+	for (double s : share) {
+		sum += s;
+	}
+	return sum / static_cast<double>(trials);
+}
+
+/** The contents of a table file */
+struct equity_table_data {
+	unsigned int opponents = 0; /**< The largest number of opponents of the preflop entries */
+	std::uint64_t preflop_trials = 0; /**< The samples of each preflop entry */
+	std::uint64_t flop_trials = 0; /**< The samples of each flop entry */
+	std::uint64_t seed = 0; /**< The seed of every entry, see detail::entry_seed() */
+	std::vector<float> preflop; /**< 169 * opponents entries */
+	std::vector<float> flop; /**< Empty, or an entry per flop class */
+};
+
+/** Write a table file, through a temporary file renamed into place
+ * @param path The path of the file
+ * @param data The table
+ */
+inline void write_equity_table(std::string const& path, equity_table_data const& data)
+{
+	if (data.preflop.size() != static_cast<std::size_t>(detail::preflop_classes) * data.opponents
+		|| (!data.flop.empty() && data.flop.size() != detail::flop_classes)) {
+		throw std::invalid_argument("The table has a wrong number of entries");
+	}
+	unsigned char header[detail::table_header_size] = {};
+	std::memcpy(header, detail::table_magic, 4);
+	detail::put_u32(header + 4, detail::table_version);
+	std::memcpy(header + 8, &detail::table_byte_order, 4);
+	detail::put_u32(header + 12, data.opponents);
+	detail::put_u64(header + 16, data.preflop_trials);
+	detail::put_u64(header + 24, data.flop_trials);
+	detail::put_u64(header + 32, data.flop.size());
+	detail::put_u64(header + 40, data.seed);
+
+	const std::string temp = path + ".tmp";
+	std::FILE *f = std::fopen(temp.c_str(), "wb");
+	if (!f) {
+		detail::throw_errno("fopen");
+	}
+	bool ok = std::fwrite(header, 1, sizeof header, f) == sizeof header
+		&& std::fwrite(data.preflop.data(), sizeof(float), data.preflop.size(), f) == data.preflop.size()
+		&& std::fwrite(data.flop.data(), sizeof(float), data.flop.size(), f) == data.flop.size();
+	ok = std::fclose(f) == 0 && ok;
+	if (!ok || std::rename(temp.c_str(), path.c_str()) != 0) {
+		int err = errno;
+		std::remove(temp.c_str());
+		throw std::system_error(err, std::generic_category(), "write_equity_table");
+	}
+}
+
+/**
+ * Equity lookups from a table file mapped into memory
+ * An entry the table lacks is computed by live_equity(), with live_trials samples.
+ */
+class equity_table {
+public:
+	/** A table without a file: every lookup is computed */
+	equity_table() : indexer{hand_indexer::holdem()}
+	{
+		build_classes();
+	}
+
+	/** Map a table file
+	 * @param path The path of the file
+	 */
+	explicit equity_table(std::string const& path) : indexer{hand_indexer::holdem()}
+	{
+		build_classes();
+		fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0) {
+			detail::throw_errno("open");
+		}
+		try {
+			map();
+		} catch (...) {
+			unmap();
+			::close(fd);
+			throw;
+		}
+	}
+
+	equity_table(equity_table const&) = delete;
+	equity_table& operator=(equity_table const&) = delete;
+
+	~equity_table()
+	{
+		unmap();
+		if (fd >= 0) {
+			::close(fd);
+		}
+	}
+
+	/** @return The largest number of opponents of the preflop entries, 0 without a file */
+	inline unsigned int opponents() const
+	{
+		return max_opponents;
+	}
+
+	/** @return Whether the table has the flop entries */
+	inline bool has_flop() const
+	{
+		return flop_entries != nullptr;
+	}
+
+	/** @return The preflop class (0 - 168) of hole cards */
+	inline unsigned int preflop_class(card_set hole) const
+	{
+		check_hole(hole);
+		return classes[detail::combo_of(hole)];
+	}
+
+	/** The equity of hole cards before the flop
+	 * @param hole The hole cards
+	 * @param opponents The number of random opponents
+	 * @return The expected share of the pot
+	 */
+	double preflop(card_set hole, unsigned int opponents) const
+	{
+		const unsigned int c = preflop_class(hole);
+		if (opponents >= 1 && opponents <= max_opponents) {
+			return preflop_entries[c * max_opponents + opponents - 1];
+		}
+		return live_equity(hole, card_set{}, opponents, live_trials, detail::entry_seed(seed, 0, c * 64 + opponents), live_threads);
+	}
+
+	/** The equity of hole cards on the flop against one random opponent
+	 * @param hole The hole cards
+	 * @param flop The flop, 3 cards
+	 * @return The expected share of the pot
+	 */
+	double flop(card_set hole, card_set flop) const
+	{
+		check_hole(hole);
+		const card_set hand[2] = {hole, flop};
+		const std::uint64_t c = indexer.index(hand, 2);
+		if (flop_entries) {
+			return flop_entries[c];
+		}
+		return live_equity(hole, flop, 1, live_trials, detail::entry_seed(seed, 1, c), live_threads);
+	}
+
+	/** @return The indexer of the flop entries */
+	inline hand_indexer const& flop_indexer() const
+	{
+		return indexer;
+	}
+
+	std::uint64_t live_trials = 100000; /**< The samples of a lookup the table lacks */
+	unsigned int live_threads = 1; /**< The workers of a lookup the table lacks. 0 is one per hardware thread. */
+
+private:
+	static void check_hole(card_set hole)
+	{
+		if (hole.size() != 2 || (hole.mask() & ~card_set::full_deck)) {
+			throw std::invalid_argument("Hole cards are 2 cards without a joker");
+		}
+	}
+
+	void build_classes()
+	{
+		for (unsigned int b = 1; b < 52; ++b) {
+			for (unsigned int a = 0; a < b; ++a) {
+				const card_set hole{1ull << (a / 13 * 16 + a % 13) | 1ull << (b / 13 * 16 + b % 13)};
+				classes[b * (b - 1) / 2 + a] = static_cast<std::uint8_t>(indexer.index(&hole, 1));
+			}
+		}
+	}
+
+	void map()
+	{
+		struct stat st;
+		if (::fstat(fd, &st) != 0) {
+			detail::throw_errno("fstat");
+		}
+		if (static_cast<std::size_t>(st.st_size) < detail::table_header_size) {
+			throw std::invalid_argument("Not an equity table file");
+		}
+		length = static_cast<std::size_t>(st.st_size);
+		void *p = ::mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+		if (p == MAP_FAILED) {
+			length = 0;
+			detail::throw_errno("mmap");
+		}
+		base = static_cast<unsigned char const *>(p);
+		std::uint32_t order;
+		std::memcpy(&order, base + 8, 4);
+		if (std::memcmp(base, detail::table_magic, 4) != 0 || detail::get_u32(base + 4) != detail::table_version) {
+			throw std::invalid_argument("Not an equity table file of this version");
+		}
+		if (order != detail::table_byte_order) {
+			throw std::invalid_argument("The equity table file is of another byte order");
+		}
+		max_opponents = detail::get_u32(base + 12);
+		const std::uint64_t flops = detail::get_u64(base + 32);
+		seed = detail::get_u64(base + 40);
+		const std::uint64_t preflops = static_cast<std::uint64_t>(detail::preflop_classes) * max_opponents;
+		if (max_opponents > 22 || (flops != 0 && flops != detail::flop_classes)
+			|| length != detail::table_header_size + (preflops + flops) * sizeof(float)) {
+			throw std::invalid_argument("Malformed equity table file");
+		}
+		preflop_entries = reinterpret_cast<float const *>(base + detail::table_header_size);
+		flop_entries = flops ? preflop_entries + preflops : nullptr;
+	}
+
+	void unmap()
+	{
+		if (length) {
+			::munmap(const_cast<unsigned char *>(base), length);
+			length = 0;
+		}
+	}
+
+	hand_indexer indexer;
+	std::uint8_t classes[1326]; /**< The preflop class of each combo */
+	int fd = -1;
+	unsigned char const *base = nullptr; /**< The mapping */
+	std::size_t length = 0; /**< The size of the mapping */
+	unsigned int max_opponents = 0;
+	std::uint64_t seed = 0;
+	float const *preflop_entries = nullptr;
+	float const *flop_entries = nullptr;
+};
+
+} // namespace pk
+#endif // EQUITY_TABLE_H_
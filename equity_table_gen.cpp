@@ -0,0 +1,124 @@
+/* equity_table_gen.cpp Copyright 2019, 2023 TNPLR
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * The generator of equity table files, see equity_table.h
+ *     g++ -std=c++17 -O2 -pthread equity_table_gen.cpp poker.cpp -o equity_table_gen
+ *     ./equity_table_gen --out=FILE [--opponents=N] [--preflop-trials=T] [--flop-trials=T]
+ *                        [--seed=S] [--threads=N]
+ * Every entry is sampled by live_equity() with its own stream, so a file depends
+ * only on the flags, not on the number of threads. --flop-trials=0 leaves out the
+ * flop entries. The standard error of an entry is at most 0.5 / sqrt(trials).
+ */
+#include "equity_table.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace {
+
+/** @return The value of a --name=value argument, or an empty string */
+std::string flag(int argc, char **argv, char const *name)
+{
+	const std::string prefix = std::string("--") + name + "=";
+	for (int i = 1; i < argc; ++i) {
+		if (std::strncmp(argv[i], prefix.c_str(), prefix.size()) == 0) {
+			return argv[i] + prefix.size();
+		}
+	}
+	return "";
+}
+
+std::uint64_t number_flag(int argc, char **argv, char const *name, std::uint64_t fallback)
+{
+	const std::string v = flag(argc, argv, name);
+	return v.empty() ? fallback : std::strtoull(v.c_str(), nullptr, 10);
+}
+
+/** Run fn(entry) for every entry on every worker, reporting the progress */
+template <class F>
+void for_entries(char const *name, std::uint64_t entries, unsigned int threads, F&& fn)
+{
+	const unsigned int workers = pk::detail::worker_count(threads, entries);
+	pk::detail::work_ranges ranges(workers, static_cast<std::uint32_t>(entries));
+	std::atomic<std::uint64_t> done{0};
+	const auto start = std::chrono::steady_clock::now();
+	pk::detail::run_workers(workers, [&](unsigned int w) {
+		std::uint32_t e;
+		while (ranges.next(w, e)) {
+			fn(e);
+			const std::uint64_t n = done.fetch_add(1, std::memory_order_relaxed) + 1;
+			if (w == 0 && (n * 100 / entries) != ((n - 1) * 100 / entries)) {
+				std::cerr << '\r' << name << ' ' << n * 100 / entries << '%' << std::flush;
+			}
+		}
+	});
+	const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	std::cerr << '\r' << name << ' ' << entries << " entries in " << seconds << " s\n";
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+	const std::string out = flag(argc, argv, "out");
+	pk::equity_table_data data;
+	data.opponents = static_cast<unsigned int>(number_flag(argc, argv, "opponents", 9));
+	data.preflop_trials = number_flag(argc, argv, "preflop-trials", 200000);
+	data.flop_trials = number_flag(argc, argv, "flop-trials", 2000);
+	data.seed = number_flag(argc, argv, "seed", 20190101u);
+	const unsigned int threads = static_cast<unsigned int>(number_flag(argc, argv, "threads", 0));
+	if (out.empty()) {
+		std::cerr << "usage: equity_table_gen --out=FILE [--opponents=N] [--preflop-trials=T] [--flop-trials=T] [--seed=S] [--threads=N]\n";
+		return 1;
+	}
+	if (data.opponents < 1 || data.opponents > 22 || data.preflop_trials == 0) {
+		std::cerr << "--opponents must be 1 - 22 and --preflop-trials positive\n";
+		return 1;
+	}
+
+	const pk::hand_indexer indexer = pk::hand_indexer::holdem();
+	try {
+		data.preflop.resize(static_cast<std::size_t>(pk::detail::preflop_classes) * data.opponents);
+		for_entries("preflop", data.preflop.size(), threads, [&](std::uint64_t e) {
+			const unsigned int c = static_cast<unsigned int>(e / data.opponents);
+			const unsigned int opponents = static_cast<unsigned int>(e % data.opponents) + 1;
+			const pk::card_set hole = indexer.unrank(0, c)[0];
+			data.preflop[e] = static_cast<float>(pk::live_equity(hole, pk::card_set{}, opponents, data.preflop_trials,
+				pk::detail::entry_seed(data.seed, 0, c * 64 + opponents)));
+		});
+		if (data.flop_trials) {
+			data.flop.resize(pk::detail::flop_classes);
+			for_entries("flop", data.flop.size(), threads, [&](std::uint64_t e) {
+				const std::vector<pk::card_set> hand = indexer.unrank(1, e);
+				data.flop[e] = static_cast<float>(pk::live_equity(hand[0], hand[1], 1, data.flop_trials,
+					pk::detail::entry_seed(data.seed, 1, e)));
+			});
+		}
+		pk::write_equity_table(out, data);
+	} catch (std::exception const& e) {
+		std::cerr << "equity_table_gen: " << e.what() << '\n';
+		return 1;
+	}
+	std::cout << out << ": " << data.opponents << " opponents, " << data.preflop_trials << " preflop trials, "
+		<< (data.flop.empty() ? std::string("no flop entries") : std::to_string(data.flop_trials) + " flop trials") << '\n';
+	return 0;
+}
@@ -0,0 +1,615 @@
+/* evaluator.h Copyright 2019, 2023 TNPLR
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef EVALUATOR_H_
+#define EVALUATOR_H_
+
+#include "poker.h"
+
+#include <cstdint>
+#include <cstddef>
+#include <stdexcept>
+#include <vector>
+
+/*
+ * Texas Hold'em hand evaluator
+ * A hand of 5, 6 or 7 cards is ranked by its best 5 cards into a 16-bit strength.
+ * A greater strength is a better hand, and equal strengths are a tie.
+ * E.g.
+ *     pk::hand_strength s = pk::evaluate(pk::card_set{game[0]} | board);
+ *     if (pk::category(s) == pk::hand_category::flush) ...
+ *
+ * The top 4 bits of a strength are the hand_category and the low 12 bits rank
+ * the hand inside its category. Jokers are ignored.
+ */
+namespace pk {
+
+/** A comparable strength of a hand */
+using hand_strength = std::uint16_t;
+
+/** This enumerator is the category of a hand, in ascending order */
+enum class hand_category : unsigned int {
+	high_card = 0, /**< No pair */
+	one_pair, /**< One pair */
+	two_pair, /**< Two pair */
+	three_of_a_kind, /**< Three of a kind */
+	straight, /**< Five ranks in a row */
+	flush, /**< Five cards in one suit */
+	full_house, /**< Three of a kind and a pair */
+	four_of_a_kind, /**< Four of a kind */
+	straight_flush, /**< A straight in one suit */
+};
+
+/** @return The category of a hand strength */
+constexpr hand_category category(hand_strength strength)
+{
+	return static_cast<hand_category>(strength >> 12);
+}
+
+namespace detail {
+/** @return The index of the highest set bit of x. x must not be zero. */
+constexpr unsigned int hibit(unsigned int x)
+{
+#if __GNUC__
+	return 31u - static_cast<unsigned int>(__builtin_clz(x));
+#else
+	unsigned int n = 0;
+	while (x >>= 1) {
+		++n;
+	}
+	return n;
+#endif // __GNUC__
+}
+
+/** @return The rank mask m without its lowest bits, so that at most k bits remain */
+constexpr unsigned int keep_top(unsigned int m, unsigned int k)
+{
+	while (popcount64(m) > k) {
+		m &= m - 1;
+	}
+	return m;
+}
+
+/** @return A strength of a category and the rank inside it */
+constexpr hand_strength make_strength(hand_category cat, unsigned int value)
+{
+	return static_cast<hand_strength>(static_cast<unsigned int>(cat) << 12 | value);
+}
+
+/**
+ * The lookup tables of the evaluator, indexed by 13-bit rank masks
+ * They are computed by the compiler, so they are ready in read-only data at startup
+ * and shared by every process mapping the binary.
+ */
+struct evaluator_tables {
+	/** binom[n][k] = C(n, k) for n < 13, k <= 5 */
+	std::uint16_t binom[13][6]{};
+	/** Straight flush or flush strength of a suit mask with at least 5 cards */
+	hand_strength flush[8192]{};
+	/** Straight or high card strength of a mask of distinct ranks */
+	hand_strength distinct[8192]{};
+
+	constexpr evaluator_tables()
+	{
+		for (unsigned int n = 0; n < 13; ++n) {
+			binom[n][0] = 1;
+			for (unsigned int k = 1; k <= 5; ++k) {
+				binom[n][k] = n == 0 ? 0 : static_cast<std::uint16_t>(binom[n - 1][k - 1] + binom[n - 1][k]);
+			}
+		}
+		for (unsigned int m = 0; m < 8192; ++m) {
+			unsigned int top = straight_top(m);
+			unsigned int high = ordinal(keep_top(m, 5));
+			if (top) {
+				distinct[m] = make_strength(hand_category::straight, top);
+				flush[m] = make_strength(hand_category::straight_flush, top);
+			} else {
+				distinct[m] = make_strength(hand_category::high_card, high);
+				flush[m] = make_strength(hand_category::flush, high);
+			}
+		}
+	}
+
+	/** @return The rank of a mask among the masks with the same number of bits (colex order) */
+	constexpr unsigned int ordinal(unsigned int m) const
+	{
+		unsigned int rank = 0;
+		for (unsigned int i = 1; m; ++i, m &= m - 1) {
+			rank += binom[ctz64(m)][i];
+		}
+		return rank;
+	}
+
+	/** @return The rank index of the top card of the best straight in m, or 0 if there is none */
+	static constexpr unsigned int straight_top(unsigned int m)
+	{
+		for (unsigned int top = 12; top >= 4; --top) {
+			unsigned int run = 0x1Fu << (top - 4);
+			if ((m & run) == run) {
+				return top;
+			}
+		}
+		return (m & 0x100Fu) == 0x100Fu ? 3 : 0;
+	}
+};
+
+/** The lookup tables of the evaluator */
+inline constexpr evaluator_tables evaluator_table{};
+
+static_assert(evaluator_table.distinct[0x1F00] == make_strength(hand_category::straight, 12), "Broadway is the best straight");
+static_assert(evaluator_table.flush[0x100F] == make_strength(hand_category::straight_flush, 3), "The wheel is the least straight flush");
+static_assert(evaluator_table.distinct[0x1F] == make_strength(hand_category::straight, 4), "Six high is a straight");
+
+/** @return The lookup tables of the evaluator */
+constexpr evaluator_tables const& tables()
+{
+	return evaluator_table;
+}
+
+/**
+ * Rank a hand from the ranks held at least once, twice, three and four times
+ * @param once The rank mask of ranks held at least once
+ * @param twice The rank mask of ranks held at least twice
+ * @param thrice The rank mask of ranks held at least three times
+ * @param quad The rank mask of ranks held four times
+ * @param flush The rank mask of a suit holding at least 5 cards, or 0 if there is none
+ * @param t The lookup tables
+ */
+inline hand_strength evaluate_counts(unsigned int once, unsigned int twice, unsigned int thrice, unsigned int quad,
+	unsigned int flush, evaluator_tables const& t)
+{
+	// With at most 7 cards, a flush excludes four of a kind and full house
+	if (flush) {
+		return t.flush[flush];
+	}
+	if (quad) {
+		unsigned int q = hibit(quad);
+		unsigned int rest = once & ~quad;
+		return make_strength(hand_category::four_of_a_kind, q * 13 + (rest ? hibit(rest) : 0));
+	}
+	if (thrice) {
+		unsigned int trip = hibit(thrice);
+		unsigned int pair = twice & ~(1u << trip);
+		if (pair) {
+			return make_strength(hand_category::full_house, trip * 13 + hibit(pair));
+		}
+	}
+	hand_strength distinct = t.distinct[once];
+	if (category(distinct) == hand_category::straight) {
+		return distinct;
+	}
+	if (thrice) {
+		unsigned int trip = hibit(thrice);
+		return make_strength(hand_category::three_of_a_kind, trip * 78 + t.ordinal(keep_top(once & ~thrice, 2)));
+	}
+	if (twice & (twice - 1)) {
+		unsigned int pairs = keep_top(twice, 2);
+		unsigned int rest = once & ~pairs;
+		return make_strength(hand_category::two_pair, t.ordinal(pairs) * 13 + (rest ? hibit(rest) : 0));
+	}
+	if (twice) {
+		return make_strength(hand_category::one_pair, hibit(twice) * 286 + t.ordinal(keep_top(once & ~twice, 3)));
+	}
+	return distinct;
+}
+
+/** Rank a hand from the ranks held at least once, twice, three and four times, see above */
+inline hand_strength evaluate_counts(unsigned int once, unsigned int twice, unsigned int thrice, unsigned int quad, unsigned int flush)
+{
+	return evaluate_counts(once, twice, thrice, quad, flush, tables());
+}
+
+/** Rank a hand from the rank masks of its suits with the lookup tables t, see evaluate() */
+inline hand_strength evaluate_masks(unsigned int club, unsigned int diamond, unsigned int heart, unsigned int spade,
+	evaluator_tables const& t)
+{
+	// Bit-sliced count of each rank over the four suits
+	unsigned int a = club ^ diamond, b = club & diamond;
+	unsigned int e = heart ^ spade, f = heart & spade;
+	unsigned int low = a ^ e, carry = a & e;
+	unsigned int mid = b ^ f ^ carry;
+	unsigned int high = (b & f) | (carry & (b ^ f));
+
+	unsigned int flush = 0;
+	flush = popcount64(club) >= 5 ? club : flush;
+	flush = popcount64(diamond) >= 5 ? diamond : flush;
+	flush = popcount64(heart) >= 5 ? heart : flush;
+	flush = popcount64(spade) >= 5 ? spade : flush;
+
+	return evaluate_counts(club | diamond | heart | spade, mid | high, (mid & low) | high, high, flush, t);
+}
+} // namespace detail
+
+/**
+ * Rank a hand from the rank masks of its suits
+ * @param club The 13-bit rank mask of clubs (bit 0 - 12 are Two to Ace)
+ * @param diamond The rank mask of diamonds
+ * @param heart The rank mask of hearts
+ * @param spade The rank mask of spades
+ * @return The strength of the best 5 cards
+ */
+inline hand_strength evaluate(unsigned int club, unsigned int diamond, unsigned int heart, unsigned int spade)
+{
+	return detail::evaluate_masks(club, diamond, heart, spade, detail::tables());
+}
+
+/** Rank a hand of 5, 6 or 7 cards
+ * @param cs The cards
+ * @return The strength of the best 5 cards
+ */
+inline hand_strength evaluate(card_set cs)
+{
+	PK_PROBE(evaluate);
+	return evaluate(cs.suit_mask(CLUB), cs.suit_mask(DIAMOND), cs.suit_mask(HEART), cs.suit_mask(SPADE));
+}
+
+/** Rank a hand of 5, 6 or 7 cards
+ * @param dk The cards
+ * @return The strength of the best 5 cards
+ */
+inline hand_strength evaluate(deck const& dk)
+{
+	return evaluate(card_set{dk});
+}
+
+/**
+ * A hand which keeps the state of the evaluator up to date
+ * Adding or removing a card updates the rank counts, the suit masks and the
+ * masks of ranks held at least 1 - 4 times in O(1), so strength() is one call of
+ * the ranking stage, with no recount. Duplicated cards of a multi-deck shoe count
+ * towards pairs, trips and quads. Jokers are kept but not ranked.
+ * E.g.
+ *     pk::tracked_hand th{game[0]};
+ *     th.add(game.draw(0));
+ *     game.play(0, c);
+ *     th.remove(c);
+ *     pk::hand_strength s = th.strength();
+ */
+class tracked_hand {
+public:
+	/** An empty hand */
+	tracked_hand() = default;
+
+	/** A hand of the cards of a deck
+	 * @param dk The deck
+	 */
+	explicit tracked_hand(deck const& dk)
+	{
+		for (unsigned int i = 0; i < dk.size(); ++i) {
+			add(dk[i]);
+		}
+	}
+
+	/** Put a card into the hand
+	 * @param c Card to put into, Ace to King or a joker
+	 */
+	inline void add(card const& c)
+	{
+		check_number(c.number);
+		++count;
+		if (c.number == 14) {
+			++jokers;
+			return;
+		}
+		const unsigned int r = card_set::rank_index(c.number);
+		const unsigned int bit = 1u << r;
+		if (cards[c.suit][r]++ == 0) {
+			suits[c.suit] |= bit;
+			++distinct[c.suit];
+		}
+		const unsigned int n = ranks[r]++;
+		if (n < 4) {
+			at_least[n] |= bit;
+		}
+	}
+
+	/** Remove a card from the hand
+	 * @param c Card to remove
+	 */
+	inline void remove(card const& c)
+	{
+		check_number(c.number);
+		if (c.number == 14) {
+			if (jokers == 0) {
+				throw std::invalid_argument("He or she does not have the card");
+			}
+			--jokers;
+			--count;
+			return;
+		}
+		const unsigned int r = card_set::rank_index(c.number);
+		const unsigned int bit = 1u << r;
+		if (cards[c.suit][r] == 0) {
+			throw std::invalid_argument("He or she does not have the card");
+		}
+		--count;
+		if (--cards[c.suit][r] == 0) {
+			suits[c.suit] &= ~bit;
+			--distinct[c.suit];
+		}
+		const unsigned int n = --ranks[r];
+		if (n < 4) {
+			at_least[n] &= ~bit;
+		}
+	}
+
+	/** @return The number of cards */
+	inline size_t size() const
+	{
+		return count;
+	}
+
+	/** @return How many cards of a rank the hand has
+	 * @param number The number of the card (1 - 13, or 14 for jokers)
+	 */
+	inline unsigned int rank_count(unsigned int number) const
+	{
+		check_number(number);
+		return number == 14 ? jokers : ranks[card_set::rank_index(number)];
+	}
+
+	/** @return How many different ranks of a suit the hand has
+	 * @param suit the suit (enumerator)
+	 */
+	inline unsigned int suit_count(int suit) const
+	{
+		return distinct[suit];
+	}
+
+	/** @return The 13-bit rank mask of a suit (bit 0 - 12 are Two to Ace)
+	 * @param suit the suit (enumerator)
+	 */
+	inline unsigned int suit_mask(int suit) const
+	{
+		return suits[suit];
+	}
+
+	/** @return The strength of the best 5 cards, for hands of at most 7 cards */
+	inline hand_strength strength() const
+	{
+		unsigned int flush = 0;
+		for (int suit = CLUB; suit <= SPADE; ++suit) {
+			flush = distinct[suit] >= 5 ? suits[suit] : flush;
+		}
+		return detail::evaluate_counts(at_least[0], at_least[1], at_least[2], at_least[3], flush);
+	}
+
+private:
+	/** Throw unless number is Ace to King or a joker, which are all a hand can hold */
+	static inline void check_number(unsigned int number)
+	{
+		if (number == 0 || number > 14) {
+			throw std::invalid_argument("Not a card number");
+		}
+	}
+
+	std::uint32_t cards[4][13]{}; /**< Multiplicity of each card */
+	std::uint32_t ranks[13]{}; /**< Multiplicity of each rank */
+	unsigned int at_least[4]{}; /**< at_least[n] is the mask of ranks held more than n times */
+	unsigned int suits[4]{}; /**< Rank mask of each suit */
+	unsigned int distinct[4]{}; /**< Number of ranks of each suit */
+	unsigned int jokers = 0; /**< Number of jokers */
+	size_t count = 0; /**< Number of cards */
+};
+
+/**
+ * Hands in structure-of-arrays form, one lane per hand
+ * Lane i is the hand {club[i], diamond[i], heart[i], spade[i]} of 13-bit rank masks.
+ */
+struct hand_batch {
+	const std::uint16_t *club; /**< Rank masks of clubs */
+	const std::uint16_t *diamond; /**< Rank masks of diamonds */
+	const std::uint16_t *heart; /**< Rank masks of hearts */
+	const std::uint16_t *spade; /**< Rank masks of spades */
+	std::size_t size; /**< The number of hands */
+};
+
+/**
+ * Storage of hands in structure-of-arrays form
+ * E.g.
+ *     pk::hand_batch_buffer hands;
+ *     hands.push_back(hole | board);
+ *     pk::evaluate(hands.view(), out.data());
+ */
+class hand_batch_buffer {
+public:
+	/** Put a hand into the buffer
+	 * @param cs The cards of the hand
+	 */
+	inline void push_back(card_set cs)
+	{
+		suits[CLUB].push_back(cs.suit_mask(CLUB));
+		suits[DIAMOND].push_back(cs.suit_mask(DIAMOND));
+		suits[HEART].push_back(cs.suit_mask(HEART));
+		suits[SPADE].push_back(cs.suit_mask(SPADE));
+	}
+
+	/** Remove every hand but keep the storage */
+	inline void clear()
+	{
+		for (auto& v : suits) {
+			v.clear();
+		}
+	}
+
+	/** Reserve storage for hands
+	 * @param n The number of hands
+	 */
+	inline void reserve(std::size_t n)
+	{
+		for (auto& v : suits) {
+			v.reserve(n);
+		}
+	}
+
+	/** @return The number of hands */
+	inline std::size_t size() const
+	{
+		return suits[0].size();
+	}
+
+	/** @return A view of the hands for evaluate(hand_batch, ...) */
+	inline hand_batch view() const
+	{
+		return hand_batch{suits[CLUB].data(), suits[DIAMOND].data(), suits[HEART].data(), suits[SPADE].data(), size()};
+	}
+
+private:
+	std::vector<std::uint16_t> suits[4]; /**< Rank masks per suit */
+};
+
+/** This enumerator is the target a batch kernel is compiled for
+ * Every kernel is the same scalar loop; only the instructions the compiler may use differ.
+ */
+enum class simd_isa {
+	scalar, /**< The baseline target */
+	neon, /**< The baseline target, which includes ARM NEON */
+	avx2, /**< The scalar loop compiled for x86 AVX2 */
+	avx512, /**< The scalar loop compiled for x86 AVX-512 (F and BW) */
+};
+
+namespace detail {
+/** The number of lanes counted before they are ranked */
+constexpr std::size_t batch_block = 64;
+
+/** 16-bit popcount written with shifts and adds, so it vectorizes on every instruction set */
+inline std::uint16_t popcount16(std::uint16_t x)
+{
+	x = x - ((x >> 1) & 0x5555);
+	x = (x & 0x3333) + ((x >> 2) & 0x3333);
+	x = (x + (x >> 4)) & 0x0F0F;
+	return static_cast<std::uint16_t>((x + (x >> 8)) & 0x1F);
+}
+
+/** Evaluate the hands of a batch
+ * The counting stage is branch-free over a block of lanes, so the compiler turns it
+ * into vector code of the target the caller is compiled for. The ranking stage runs per lane.
+ */
+#if __GNUC__
+__attribute__((always_inline))
+#endif // __GNUC__
+inline void batch_loop(hand_batch const& hands, hand_strength *out)
+{
+	std::uint16_t once[batch_block], twice[batch_block], thrice[batch_block], quad[batch_block], flush[batch_block];
+	std::uint16_t tail[4][batch_block];
+	for (std::size_t base = 0; base < hands.size; base += batch_block) {
+		const std::size_t n = hands.size - base < batch_block ? hands.size - base : batch_block;
+		const std::uint16_t *c = hands.club + base, *d = hands.diamond + base;
+		const std::uint16_t *h = hands.heart + base, *s = hands.spade + base;
+		if (n < batch_block) {
+			// Pad the last block, so that the counting loop always has a fixed trip count
+			for (std::size_t i = 0; i < batch_block; ++i) {
+				tail[CLUB][i] = i < n ? c[i] : 0;
+				tail[DIAMOND][i] = i < n ? d[i] : 0;
+				tail[HEART][i] = i < n ? h[i] : 0;
+				tail[SPADE][i] = i < n ? s[i] : 0;
+			}
+			c = tail[CLUB];
+			d = tail[DIAMOND];
+			h = tail[HEART];
+			s = tail[SPADE];
+		}
+		for (std::size_t i = 0; i < batch_block; ++i) {
+			std::uint16_t a = c[i] ^ d[i], b = c[i] & d[i];
+			std::uint16_t e = h[i] ^ s[i], f = h[i] & s[i];
+			std::uint16_t low = a ^ e, carry = a & e;
+			std::uint16_t mid = b ^ f ^ carry;
+			std::uint16_t high = (b & f) | (carry & (b ^ f));
+			once[i] = c[i] | d[i] | h[i] | s[i];
+			twice[i] = mid | high;
+			thrice[i] = (mid & low) | high;
+			quad[i] = high;
+			std::uint16_t fl = 0;
+			fl = popcount16(c[i]) >= 5 ? c[i] : fl;
+			fl = popcount16(d[i]) >= 5 ? d[i] : fl;
+			fl = popcount16(h[i]) >= 5 ? h[i] : fl;
+			fl = popcount16(s[i]) >= 5 ? s[i] : fl;
+			flush[i] = fl;
+		}
+		for (std::size_t i = 0; i < n; ++i) {
+			out[base + i] = evaluate_counts(once[i], twice[i], thrice[i], quad[i], flush[i]);
+		}
+	}
+}
+
+/** batch_loop compiled for the baseline target */
+inline void batch_scalar(hand_batch const& hands, hand_strength *out)
+{
+	batch_loop(hands, out);
+}
+
+#if (__x86_64__ || __i386__) && __GNUC__
+#define POKER_BATCH_X86 1
+/** batch_loop compiled for AVX2, not a hand-written vector kernel */
+__attribute__((target("avx2"))) inline void batch_scalar_avx2(hand_batch const& hands, hand_strength *out)
+{
+	batch_loop(hands, out);
+}
+
+/** batch_loop compiled for AVX-512, not a hand-written vector kernel */
+__attribute__((target("avx512f,avx512bw"))) inline void batch_scalar_avx512(hand_batch const& hands, hand_strength *out)
+{
+	batch_loop(hands, out);
+}
+#endif // (__x86_64__ || __i386__) && __GNUC__
+
+/** The selected batch kernel */
+struct batch_dispatch {
+	void (*kernel)(hand_batch const&, hand_strength *);
+	simd_isa isa;
+
+	batch_dispatch() : kernel{&batch_scalar}, isa{simd_isa::scalar}
+	{
+#if POKER_BATCH_X86
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")) {
+			kernel = &batch_scalar_avx512;
+			isa = simd_isa::avx512;
+		} else if (__builtin_cpu_supports("avx2")) {
+			kernel = &batch_scalar_avx2;
+			isa = simd_isa::avx2;
+		}
+#elif __ARM_NEON
+		// NEON is part of the baseline, so batch_scalar may already use it
+		isa = simd_isa::neon;
+#endif // POKER_BATCH_X86
+	}
+};
+
+/** @return The batch kernel for the running CPU, chosen by CPUID at first use */
+inline batch_dispatch const& batch_kernel()
+{
+	static const batch_dispatch d;
+	return d;
+}
+} // namespace detail
+
+/** @return The instruction set of the batch kernel chosen for the running CPU */
+inline simd_isa batch_isa()
+{
+	return detail::batch_kernel().isa;
+}
+
+/** Rank a batch of hands
+ * @param hands The hands in structure-of-arrays form
+ * @param out The output of hands.size strengths
+ */
+inline void evaluate(hand_batch const& hands, hand_strength *out)
+{
+	PK_PROBE(evaluate_batch);
+	detail::batch_kernel().kernel(hands, out);
+}
+
+} // namespace pk
+#endif // EVALUATOR_H_
@@ -0,0 +1,368 @@
+/* history.h Copyright 2019, 2023 TNPLR
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef HISTORY_H_
+#define HISTORY_H_
+
+#include "poker.h"
+#include "serialize.h"
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#if __unix__ || __APPLE__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+// Only the POSIX build has history.h; callers guard their include with the same condition
+#error "history.h needs POSIX mmap"
+#endif // __unix__ || __APPLE__
+
+/*
+ * Append-only hand history files
+ * A file holds snapshots of one kind of table (players, decks, jokers) in the
+ * format of serialize.h. The cards of a table never exceed its full pile, so every
+ * snapshot fits one fixed stride, and hand n is at a fixed offset:
+ *
+ *     header    64 bytes: "PKHH", version, stride, players, decks, joker
+ *     record n  at 64 + n * stride: u32 length, then the encoded poker, then padding
+ *
+ * E.g.
+ *     pk::hand_history_writer out("hands.pkh", game);
+ *     out.append(game);
+ *     ...
+ *     pk::hand_history_reader in("hands.pkh");
+ *     in.load(n, game);
+ */
+namespace pk {
+
+namespace detail {
+constexpr char history_magic[4]{'P', 'K', 'H', 'H'};
+constexpr std::uint32_t history_version = 1;
+constexpr std::size_t history_header_size = 64;
+
+inline void put_u32(unsigned char *p, std::uint32_t v)
+{
+	for (int i = 0; i < 4; ++i) {
+		p[i] = static_cast<unsigned char>(v >> (8 * i));
+	}
+}
+
+inline std::uint32_t get_u32(unsigned char const *p)
+{
+	return static_cast<std::uint32_t>(p[0]) | static_cast<std::uint32_t>(p[1]) << 8
+		| static_cast<std::uint32_t>(p[2]) << 16 | static_cast<std::uint32_t>(p[3]) << 24;
+}
+
+[[noreturn]] inline void throw_errno(char const *what)
+{
+	throw std::system_error(errno, std::generic_category(), what);
+}
+
+/** The layout of a history file */
+struct history_header {
+	std::uint32_t stride;
+	std::uint32_t players;
+	std::uint32_t decks;
+	bool joker;
+
+	/** @return The header of a kind of table */
+	static history_header of(unsigned int players, unsigned int decks, bool joker)
+	{
+		const std::uint64_t cards = static_cast<std::uint64_t>(decks) * (joker ? 54 : 52);
+		const std::uint64_t size = 4 + 2 + varint_size(players) + varint_size(decks)
+			+ (players + 1ull) * varint_size(cards) + cards;
+		if (size > 0xFFFFFFFFull) {
+			throw std::invalid_argument("The table is too large for a history file");
+		}
+		// Round up to 8 bytes, so that every record is aligned
+		return history_header{static_cast<std::uint32_t>((size + 7) & ~7ull), players, decks, joker};
+	}
+
+	void write(unsigned char *p) const
+	{
+		std::memset(p, 0, history_header_size);
+		std::memcpy(p, history_magic, 4);
+		put_u32(p + 4, history_version);
+		put_u32(p + 8, stride);
+		put_u32(p + 12, players);
+		put_u32(p + 16, decks);
+		p[20] = joker;
+	}
+
+	static history_header read(unsigned char const *p)
+	{
+		if (std::memcmp(p, history_magic, 4) != 0 || get_u32(p + 4) != history_version) {
+			throw std::invalid_argument("Not a hand history file");
+		}
+		history_header h{get_u32(p + 8), get_u32(p + 12), get_u32(p + 16), p[20] != 0};
+		if (h.stride != of(h.players, h.decks, h.joker).stride) {
+			throw std::invalid_argument("Malformed hand history header");
+		}
+		return h;
+	}
+};
+} // namespace detail
+
+/**
+ * A writer of a hand history file
+ * Records are buffered and appended with write(2); a reader sees them after flush().
+ */
+class hand_history_writer {
+public:
+	/** Open a history file for appending, creating it if needed
+	 * @param path The path of the file
+	 * @param table A game of the kind of table to record
+	 * @param buffered The number of records buffered before they are written. Default to 256.
+	 */
+	hand_history_writer(std::string const& path, poker const& table, unsigned int buffered = 256)
+		: header{detail::history_header::of(table.player_count(), table.deck_count(), table.has_joker())},
+		capacity{buffered ? buffered : 1}
+	{
+		fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+		if (fd < 0) {
+			detail::throw_errno("open");
+		}
+		struct stat st;
+		if (::fstat(fd, &st) != 0) {
+			int err = errno;
+			::close(fd);
+			throw std::system_error(err, std::generic_category(), "fstat");
+		}
+		try {
+			if (st.st_size == 0) {
+				unsigned char raw[detail::history_header_size];
+				header.write(raw);
+				write_all(raw, sizeof raw);
+				count = 0;
+			} else {
+				unsigned char raw[detail::history_header_size];
+				if (::pread(fd, raw, sizeof raw, 0) != static_cast<ssize_t>(sizeof raw)) {
+					throw std::invalid_argument("Not a hand history file");
+				}
+				detail::history_header h = detail::history_header::read(raw);
+				if (h.players != header.players || h.decks != header.decks || h.joker != header.joker) {
+					throw std::invalid_argument("The history file records another kind of table");
+				}
+				// A torn last record is overwritten by the next append
+				count = (static_cast<std::uint64_t>(st.st_size) - detail::history_header_size) / header.stride;
+				if (::ftruncate(fd, static_cast<off_t>(detail::history_header_size + count * header.stride)) != 0) {
+					detail::throw_errno("ftruncate");
+				}
+			}
+		} catch (...) {
+			::close(fd);
+			throw;
+		}
+		buffer.reserve(static_cast<std::size_t>(header.stride) * capacity);
+	}
+
+	hand_history_writer(hand_history_writer const&) = delete;
+	hand_history_writer& operator=(hand_history_writer const&) = delete;
+
+	~hand_history_writer()
+	{
+		try {
+			flush();
+		} catch (...) {
+		}
+		::close(fd);
+	}
+
+	/** Append a snapshot of a game
+	 * @param pk The game, of the kind of table of the file
+	 * @return The hand id of the record
+	 */
+	std::uint64_t append(poker const& pk)
+	{
+		if (pk.player_count() != header.players || pk.deck_count() != header.decks || pk.has_joker() != header.joker) {
+			throw std::invalid_argument("The game is another kind of table");
+		}
+		const std::size_t at = buffer.size();
+		buffer.resize(at + header.stride);
+		unsigned char *rec = buffer.data() + at;
+		std::size_t n;
+		try {
+			n = encode(pk, rec + 4, header.stride - 4);
+		} catch (...) {
+			buffer.resize(at);
+			throw;
+		}
+		detail::put_u32(rec, static_cast<std::uint32_t>(n));
+		std::memset(rec + 4 + n, 0, header.stride - 4 - n);
+		if (buffer.size() >= static_cast<std::size_t>(header.stride) * capacity) {
+			flush();
+		}
+		return count++;
+	}
+
+	/** Write every buffered record to the file */
+	void flush()
+	{
+		if (!buffer.empty()) {
+			write_all(buffer.data(), buffer.size());
+			buffer.clear();
+		}
+	}
+
+	/** @return The number of records, including the buffered ones */
+	inline std::uint64_t size() const
+	{
+		return count;
+	}
+
+private:
+	void write_all(unsigned char const *p, std::size_t n)
+	{
+		while (n > 0) {
+			ssize_t w = ::write(fd, p, n);
+			if (w < 0) {
+				if (errno == EINTR) {
+					continue;
+				}
+				detail::throw_errno("write");
+			}
+			p += w;
+			n -= static_cast<std::size_t>(w);
+		}
+	}
+
+	detail::history_header header;
+	unsigned int capacity; /**< The number of records buffered before they are written */
+	int fd;
+	std::uint64_t count; /**< The number of records */
+	std::vector<unsigned char> buffer; /**< The records not written yet */
+};
+
+/**
+ * A reader of a hand history file, mapped into memory
+ * Any hand is read in O(1) without touching the rest of the file.
+ */
+class hand_history_reader {
+public:
+	/** Map a history file
+	 * @param path The path of the file
+	 */
+	explicit hand_history_reader(std::string const& path)
+	{
+		fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0) {
+			detail::throw_errno("open");
+		}
+		try {
+			refresh();
+		} catch (...) {
+			unmap();
+			::close(fd);
+			throw;
+		}
+	}
+
+	hand_history_reader(hand_history_reader const&) = delete;
+	hand_history_reader& operator=(hand_history_reader const&) = delete;
+
+	~hand_history_reader()
+	{
+		unmap();
+		::close(fd);
+	}
+
+	/** Map the file again, to see the records appended since it was mapped */
+	void refresh()
+	{
+		struct stat st;
+		if (::fstat(fd, &st) != 0) {
+			detail::throw_errno("fstat");
+		}
+		if (static_cast<std::size_t>(st.st_size) < detail::history_header_size) {
+			throw std::invalid_argument("Not a hand history file");
+		}
+		unmap();
+		length = static_cast<std::size_t>(st.st_size);
+		void *p = ::mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+		if (p == MAP_FAILED) {
+			length = 0;
+			detail::throw_errno("mmap");
+		}
+		base = static_cast<unsigned char const *>(p);
+		header = detail::history_header::read(base);
+		count = (length - detail::history_header_size) / header.stride;
+	}
+
+	/** @return The number of records */
+	inline std::uint64_t size() const
+	{
+		return count;
+	}
+
+	/** @return The number of players of the table */
+	inline unsigned int player_count() const
+	{
+		return header.players;
+	}
+
+	/** The encoded snapshot of a hand, in place in the mapping
+	 * @param hand_id The hand id
+	 * @param len The size of the snapshot
+	 * @return The snapshot, in the format of serialize.h
+	 */
+	unsigned char const *record(std::uint64_t hand_id, std::size_t& len) const
+	{
+		if (hand_id >= count) {
+			throw std::out_of_range("The hand id is too large");
+		}
+		unsigned char const *rec = base + detail::history_header_size + hand_id * header.stride;
+		len = detail::get_u32(rec);
+		if (len > header.stride - 4) {
+			throw std::invalid_argument("Malformed hand history record");
+		}
+		return rec + 4;
+	}
+
+	/** Load a hand into a game
+	 * @param hand_id The hand id
+	 * @param pk The game
+	 */
+	void load(std::uint64_t hand_id, poker& pk) const
+	{
+		std::size_t len;
+		unsigned char const *rec = record(hand_id, len);
+		decode(rec, len, pk);
+	}
+
+private:
+	void unmap()
+	{
+		if (length) {
+			::munmap(const_cast<unsigned char *>(base), length);
+			length = 0;
+		}
+	}
+
+	int fd;
+	unsigned char const *base = nullptr; /**< The mapping */
+	std::size_t length = 0; /**< The size of the mapping */
+	detail::history_header header{};
+	std::uint64_t count = 0; /**< The number of records */
+};
+
+} // namespace pk
+#endif // HISTORY_H_
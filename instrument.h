@@ -0,0 +1,273 @@
+/* instrument.h Copyright 2019, 2023 TNPLR
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef INSTRUMENT_H_
+#define INSTRUMENT_H_
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#if __x86_64__ || __i386__
+#include <x86intrin.h>
+#endif // __x86_64__ || __i386__
+
+#if PK_INSTRUMENT_USDT
+#include <sys/sdt.h>
+#endif // PK_INSTRUMENT_USDT
+
+/*
+ * Hot path instrumentation
+ * Build with -DPK_INSTRUMENT=1 to count the calls and time stamp counter ticks of
+ * poker::shuffle, deal, draw, play, deck::sort and evaluate, per thread. Without it
+ * PK_PROBE expands to nothing and the hot paths are unchanged; the snapshot API
+ * is still there and gives zeros. PK_INSTRUMENT must be the same in every
+ * translation unit of a program.
+ * E.g.
+ *     pk::probe_counters before = pk::instrument_snapshot();
+ *     ...
+ *     pk::probe_counters spent = pk::instrument_snapshot() - before;
+ *     double seconds = spent.ticks[pk::probe_index(pk::probe::shuffle)] / pk::ticks_per_second();
+ *
+ * Tracers are attached with set_probe_hooks(), called at the begin and end of
+ * every probe (e.g. with the zone API of Tracy). With -DPK_INSTRUMENT_USDT=1 the
+ * probes pk:probe_begin(id) and pk:probe_end(id, ticks) are also emitted for perf
+ * and bpftrace; this needs <sys/sdt.h> of systemtap.
+ */
+namespace pk {
+
+/** The instrumented operations */
+enum class probe : unsigned int {
+	shuffle, /**< poker::shuffle */
+	deal, /**< poker::deal */
+	draw, /**< poker::draw */
+	play, /**< poker::play */
+	sort, /**< deck::sort */
+	evaluate, /**< evaluate of one hand */
+	evaluate_batch, /**< evaluate of a hand_batch */
+};
+
+constexpr std::size_t probe_count = 7;
+
+constexpr char const *const probe_name[probe_count]{"shuffle", "deal", "draw", "play", "sort", "evaluate", "evaluate_batch"};
+
+/** @return The index of a probe in probe_counters */
+constexpr std::size_t probe_index(probe p)
+{
+	return static_cast<std::size_t>(p);
+}
+
+/** Calls and ticks of each probe */
+struct probe_counters {
+	std::uint64_t calls[probe_count]{};
+	std::uint64_t ticks[probe_count]{};
+
+	probe_counters& operator+=(probe_counters const& rop)
+	{
+		for (std::size_t i = 0; i < probe_count; ++i) {
+			calls[i] += rop.calls[i];
+			ticks[i] += rop.ticks[i];
+		}
+		return *this;
+	}
+
+	/** @return The counts between two snapshots */
+	probe_counters operator-(probe_counters const& rop) const
+	{
+		probe_counters diff;
+		for (std::size_t i = 0; i < probe_count; ++i) {
+			diff.calls[i] = calls[i] - rop.calls[i];
+			diff.ticks[i] = ticks[i] - rop.ticks[i];
+		}
+		return diff;
+	}
+};
+
+/** Tracer callbacks, see set_probe_hooks() */
+struct probe_hooks {
+	void (*begin)(probe p, void *context); /**< Called before the operation, may be nullptr */
+	void (*end)(probe p, std::uint64_t ticks, void *context); /**< Called after the operation, may be nullptr */
+	void *context;
+};
+
+/** @return The time stamp counter, or nanoseconds where there is none */
+inline std::uint64_t read_ticks()
+{
+#if __x86_64__ || __i386__
+	return __rdtsc();
+#else
+	return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif // __x86_64__ || __i386__
+}
+
+/** @return The ticks of read_ticks() per second, measured once over 10 ms */
+inline double ticks_per_second()
+{
+#if __x86_64__ || __i386__
+	static const double rate = [] {
+		auto t0 = std::chrono::steady_clock::now();
+		std::uint64_t c0 = read_ticks();
+		while (std::chrono::steady_clock::now() - t0 < std::chrono::milliseconds(10)) {
+		}
+		auto t1 = std::chrono::steady_clock::now();
+		std::uint64_t c1 = read_ticks();
+		return (c1 - c0) / std::chrono::duration<double>(t1 - t0).count();
+	}();
+	return rate;
+#else
+	return 1e9;
+#endif // __x86_64__ || __i386__
+}
+
+namespace detail {
+struct thread_counters;
+
+/** Every live thread that has counted something, and the counts of the finished ones */
+struct instrument_registry {
+	std::mutex lock;
+	std::vector<thread_counters *> live;
+	probe_counters retired;
+};
+
+inline instrument_registry& registry()
+{
+	static instrument_registry r;
+	return r;
+}
+
+/** The counters of one thread, written by that thread only */
+struct thread_counters {
+	std::atomic<std::uint64_t> calls[probe_count]{};
+	std::atomic<std::uint64_t> ticks[probe_count]{};
+
+	thread_counters()
+	{
+		instrument_registry& r = registry();
+		std::lock_guard<std::mutex> guard{r.lock};
+		r.live.push_back(this);
+	}
+
+	~thread_counters()
+	{
+		instrument_registry& r = registry();
+		std::lock_guard<std::mutex> guard{r.lock};
+		r.retired += load();
+		r.live.erase(std::find(r.live.begin(), r.live.end(), this));
+	}
+
+	probe_counters load() const
+	{
+		probe_counters c;
+		for (std::size_t i = 0; i < probe_count; ++i) {
+			c.calls[i] = calls[i].load(std::memory_order_relaxed);
+			c.ticks[i] = ticks[i].load(std::memory_order_relaxed);
+		}
+		return c;
+	}
+
+	/** Count a call; a relaxed load and store, as no other thread writes */
+	void add(probe p, std::uint64_t spent)
+	{
+		const std::size_t i = probe_index(p);
+		calls[i].store(calls[i].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		ticks[i].store(ticks[i].load(std::memory_order_relaxed) + spent, std::memory_order_relaxed);
+	}
+};
+
+inline thread_counters& local_counters()
+{
+	thread_local thread_counters counters;
+	return counters;
+}
+
+inline std::atomic<probe_hooks const *> hooks{nullptr};
+} // namespace detail
+
+/** Attach tracer callbacks to every probe
+ * @param h The callbacks, which must outlive every instrumented call, or nullptr to detach
+ */
+inline void set_probe_hooks(probe_hooks const *h)
+{
+	detail::hooks.store(h, std::memory_order_release);
+}
+
+/** @return The counts of every thread since the start of the program */
+inline probe_counters instrument_snapshot()
+{
+	detail::instrument_registry& r = detail::registry();
+	std::lock_guard<std::mutex> guard{r.lock};
+	probe_counters total = r.retired;
+	for (detail::thread_counters const *t : r.live) {
+		total += t->load();
+	}
+	return total;
+}
+
+/** @return The counts of the calling thread since its start */
+inline probe_counters instrument_thread_snapshot()
+{
+	return detail::local_counters().load();
+}
+
+/** Counts and times the scope it lives in, see PK_PROBE */
+class probe_scope {
+public:
+	explicit probe_scope(probe p) : id{p}
+	{
+		probe_hooks const *h = detail::hooks.load(std::memory_order_acquire);
+		if (h && h->begin) {
+			h->begin(id, h->context);
+		}
+#if PK_INSTRUMENT_USDT
+		DTRACE_PROBE1(pk, probe_begin, static_cast<unsigned int>(id));
+#endif // PK_INSTRUMENT_USDT
+		start = read_ticks();
+	}
+
+	probe_scope(probe_scope const&) = delete;
+	probe_scope& operator=(probe_scope const&) = delete;
+
+	~probe_scope()
+	{
+		const std::uint64_t spent = read_ticks() - start;
+		detail::local_counters().add(id, spent);
+#if PK_INSTRUMENT_USDT
+		DTRACE_PROBE2(pk, probe_end, static_cast<unsigned int>(id), spent);
+#endif // PK_INSTRUMENT_USDT
+		probe_hooks const *h = detail::hooks.load(std::memory_order_acquire);
+		if (h && h->end) {
+			h->end(id, spent, h->context);
+		}
+	}
+
+private:
+	probe id;
+	std::uint64_t start;
+};
+
+} // namespace pk
+
+#if PK_INSTRUMENT
+/** Count and time the rest of the enclosing scope as a pk::probe */
+#define PK_PROBE(name) ::pk::probe_scope pk_probe_scope_{::pk::probe::name}
+#else
+#define PK_PROBE(name) ((void)0)
+#endif // PK_INSTRUMENT
+
+#endif // INSTRUMENT_H_
@@ -0,0 +1,480 @@
+/* isomorphism.h Copyright 2019, 2023 TNPLR
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef ISOMORPHISM_H_
+#define ISOMORPHISM_H_
+
+#include "poker.h"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+/*
+ * Suit isomorphism
+ * Hands which differ only by a permutation of suits are strategically the same:
+ * AhKh and AsKs are one hand, and so are AhKh|Qh7s2d and AsKs|Qs7c2h. A
+ * hand_indexer maps every hand of a list of rounds (e.g. 2 hole cards, then a
+ * flop of 3, a turn and a river) to a dense index of its suit-isomorphic class,
+ * and back. The cards of different rounds never mix: a pair on the board is not
+ * a pair in the hand.
+ * E.g.
+ *     pk::hand_indexer flop = pk::hand_indexer::holdem();
+ *     std::uint64_t i = flop.index({hole, board});      // round 1
+ *     std::vector<pk::card_set> c = flop.unrank(1, i);     // the canonical hand
+ *
+ * Rounds: 169 preflop, 1286792 on the flop, 55190538 on the turn, 2428287420 on the river,
+ * instead of 1326, 25989600, 1221511200 and 56189515200 hands.
+ *
+ * The index follows the hand indexing of K. Waugh: each suit holds a rank set per
+ * round, suits are sorted by their number of cards per round (the configuration
+ * of the hand), and suits of an equal configuration are interchangeable, so their
+ * rank sets are counted as a multiset.
+ */
+namespace pk {
+
+namespace detail {
+/** @return n choose k, for results which fit into 64 bits */
+inline std::uint64_t choose(std::uint64_t n, unsigned int k)
+{
+	if (k > n) {
+		return 0;
+	}
+	// Rank sets need n <= 13 only, so those are a table
+	static constexpr auto small = [] {
+		std::array<std::array<std::uint16_t, 14>, 14> t{};
+		for (unsigned int i = 0; i < 14; ++i) {
+			t[i][0] = 1;
+			for (unsigned int j = 1; j <= i; ++j) {
+				t[i][j] = static_cast<std::uint16_t>(t[i - 1][j - 1] + (j < i ? t[i - 1][j] : 0));
+			}
+		}
+		return t;
+	}();
+	if (n < 14) {
+		return small[n][k];
+	}
+	if (k < 2) {
+		return k ? n : 1;
+	}
+	std::uint64_t r = 1;
+	for (unsigned int i = 0; i < k; ++i) {
+		r = r * (n - i) / (i + 1);
+	}
+	return r;
+}
+
+/** @return The colex index of a rank set, counting the ranks among those not in used */
+inline std::uint64_t colex_rank(std::uint16_t set, std::uint16_t used = 0)
+{
+	std::uint64_t r = 0;
+	unsigned int i = 1;
+	for (std::uint64_t m = set; m; m &= m - 1, ++i) {
+		// The position of the rank among the free ranks
+		const unsigned int rank = ctz64(m);
+		r += choose(rank - popcount64(used & ((1u << rank) - 1)), i);
+	}
+	return r;
+}
+
+/** @return The rank set of size k of a colex index (the inverse of colex_rank) */
+inline std::uint16_t colex_unrank(std::uint64_t index, unsigned int k)
+{
+	std::uint16_t set = 0;
+	for (unsigned int i = k; i > 0; --i) {
+		unsigned int c = i - 1;
+		while (choose(c + 1, i) <= index) {
+			++c;
+		}
+		index -= choose(c, i);
+		set |= static_cast<std::uint16_t>(1u << c);
+	}
+	return set;
+}
+
+/** @return The ranks of a set of which bit i is the ith rank not in used */
+inline std::uint16_t expand_ranks(std::uint16_t set, std::uint16_t used)
+{
+	std::uint16_t out = 0;
+	unsigned int j = 0;
+	for (unsigned int r = 0; r < 13; ++r) {
+		if (used >> r & 1) {
+			continue;
+		}
+		out |= static_cast<std::uint16_t>((set >> j & 1) << r);
+		++j;
+	}
+	return out;
+}
+} // namespace detail
+
+/** A dense index of suit-isomorphic hands over rounds of cards */
+class hand_indexer {
+public:
+	/** The largest number of rounds */
+	static constexpr unsigned int max_rounds = 8;
+
+	/** @param cards_per_round The number of cards dealt in each round, e.g. {2, 3, 1, 1} for Hold'em */
+	explicit hand_indexer(std::vector<unsigned int> cards_per_round) : cards{std::move(cards_per_round)}
+	{
+		if (cards.empty() || cards.size() > max_rounds) {
+			throw std::invalid_argument("A hand indexer needs 1 - 8 rounds");
+		}
+		unsigned int total = 0;
+		for (unsigned int c : cards) {
+			if (c == 0) {
+				throw std::invalid_argument("A round deals at least one card");
+			}
+			total += c;
+		}
+		if (total > 52) {
+			throw std::invalid_argument("More than 52 cards over the rounds");
+		}
+		configs.resize(cards.size());
+		for (unsigned int r = 0; r < cards.size(); ++r) {
+			suit_config counts[4] = {};
+			enumerate(r, 0, 0, counts);
+			std::sort(configs[r].begin(), configs[r].end());
+			std::uint64_t offset = 0;
+			for (configuration& c : configs[r]) {
+				c.offset = offset;
+				offset += c.size;
+			}
+			sizes.push_back(offset);
+		}
+	}
+
+	/** @return The indexer of preflop hands (169 classes) */
+	static hand_indexer preflop()
+	{
+		return hand_indexer({2});
+	}
+
+	/** @return The indexer of Hold'em: 2 hole cards, the flop, the turn and the river */
+	static hand_indexer holdem()
+	{
+		return hand_indexer({2, 3, 1, 1});
+	}
+
+	/** @return The number of rounds */
+	inline unsigned int rounds() const
+	{
+		return static_cast<unsigned int>(cards.size());
+	}
+
+	/** @return The number of cards dealt in a round */
+	inline unsigned int cards_in(unsigned int round) const
+	{
+		return cards.at(round);
+	}
+
+	/** @return The number of classes of hands up to a round (0 is the first round) */
+	inline std::uint64_t size(unsigned int round) const
+	{
+		return sizes.at(round);
+	}
+
+	/** The index of a hand
+	 * @param hand The cards of each round so far; hand.size() - 1 is the round indexed
+	 * @return The index, below size(hand.size() - 1)
+	 */
+	std::uint64_t index(std::vector<card_set> const& hand) const
+	{
+		return index(hand.data(), static_cast<unsigned int>(hand.size()));
+	}
+
+	/** The index of a hand
+	 * @param hand The cards of each round so far
+	 * @param count The number of rounds; count - 1 is the round indexed
+	 * @return The index, below size(count - 1)
+	 */
+	std::uint64_t index(card_set const *hand, unsigned int count) const
+	{
+		if (count == 0 || count > cards.size()) {
+			throw std::invalid_argument("Wrong number of rounds for the hand indexer");
+		}
+		std::uint64_t seen = 0;
+		std::uint16_t ranks[4][max_rounds];
+		suit_config counts[4] = {};
+		for (unsigned int r = 0; r < count; ++r) {
+			const std::uint64_t m = hand[r].mask();
+			if ((m & ~card_set::full_deck) || (m & seen) || hand[r].size() != cards[r]) {
+				throw std::invalid_argument("The cards of a round are wrong in number, overlap or hold a joker");
+			}
+			seen |= m;
+			for (unsigned int s = 0; s < 4; ++s) {
+				ranks[s][r] = hand[r].suit_mask(s);
+				counts[s].set(r, detail::popcount64(ranks[s][r]));
+			}
+		}
+
+		// Sort the suits by configuration, the most cards first
+		unsigned int order[4] = {0, 1, 2, 3};
+		for (unsigned int i = 1; i < 4; ++i) {
+			for (unsigned int j = i; j > 0 && counts[order[j - 1]] < counts[order[j]]; --j) {
+				std::swap(order[j - 1], order[j]);
+			}
+		}
+		suit_config sorted[4];
+		for (unsigned int i = 0; i < 4; ++i) {
+			sorted[i] = counts[order[i]];
+		}
+		configuration const& c = find(count - 1, sorted);
+
+		std::uint64_t idx = 0;
+		std::uint64_t mult = 1;
+		for (unsigned int i = 0; i < 4;) {
+			unsigned int j = i + 1;
+			while (j < 4 && sorted[j] == sorted[i]) {
+				++j;
+			}
+			// Suits i - j are interchangeable: their rank sets are a multiset
+			std::uint64_t group[4];
+			for (unsigned int k = i; k < j; ++k) {
+				group[k - i] = suit_index(ranks[order[k]], sorted[k], count);
+			}
+			const unsigned int n = j - i;
+			for (unsigned int k = 1; k < n; ++k) {
+				for (unsigned int l = k; l > 0 && group[l - 1] < group[l]; --l) {
+					std::swap(group[l - 1], group[l]);
+				}
+			}
+			std::uint64_t multiset = 0;
+			for (unsigned int k = 0; k < n; ++k) {
+				multiset += detail::choose(group[k] + (n - 1 - k), n - k);
+			}
+			const std::uint64_t suits = suit_size(sorted[i], count);
+			idx += mult * multiset;
+			mult *= detail::choose(suits + n - 1, n);
+			i = j;
+		}
+		return c.offset + idx;
+	}
+
+	/** The canonical hand of an index
+	 * @param round The round (0 is the first round)
+	 * @param idx The index, below size(round)
+	 * @return The cards of each round up to round
+	 */
+	std::vector<card_set> unrank(unsigned int round, std::uint64_t idx) const
+	{
+		if (round >= cards.size() || idx >= sizes[round]) {
+			throw std::out_of_range("The index of the hand indexer is too large");
+		}
+		std::vector<configuration> const& list = configs[round];
+		auto it = std::upper_bound(list.begin(), list.end(), idx,
+			[](std::uint64_t i, configuration const& c) { return i < c.offset; });
+		configuration const& c = *(it - 1);
+		idx -= c.offset;
+
+		const unsigned int count = round + 1;
+		std::vector<card_set> hand(count);
+		std::uint64_t masks[max_rounds] = {};
+		for (unsigned int i = 0; i < 4;) {
+			unsigned int j = i + 1;
+			while (j < 4 && c.suits[j] == c.suits[i]) {
+				++j;
+			}
+			const unsigned int n = j - i;
+			const std::uint64_t suits = suit_size(c.suits[i], count);
+			const std::uint64_t multisets = detail::choose(suits + n - 1, n);
+			std::uint64_t multiset = idx % multisets;
+			idx /= multisets;
+			for (unsigned int k = 0; k < n; ++k) {
+				// The largest b with choose(b, n - k) <= multiset
+				std::uint64_t lo = n - 1 - k, hi = suits + n - 1 - k;
+				while (lo < hi) {
+					std::uint64_t mid = lo + (hi - lo + 1) / 2;
+					if (detail::choose(mid, n - k) <= multiset) {
+						lo = mid;
+					} else {
+						hi = mid - 1;
+					}
+				}
+				multiset -= detail::choose(lo, n - k);
+				std::uint16_t ranks[max_rounds];
+				suit_ranks(lo - (n - 1 - k), c.suits[i], count, ranks);
+				for (unsigned int r = 0; r < count; ++r) {
+					masks[r] |= static_cast<std::uint64_t>(ranks[r]) << ((i + k) * 16);
+				}
+			}
+			i = j;
+		}
+		for (unsigned int r = 0; r < count; ++r) {
+			hand[r] = card_set{masks[r]};
+		}
+		return hand;
+	}
+
+	/** @return The canonical hand of the class of a hand */
+	std::vector<card_set> canonical(std::vector<card_set> const& hand) const
+	{
+		return unrank(static_cast<unsigned int>(hand.size()) - 1, index(hand));
+	}
+
+private:
+	/** The number of cards of one suit in each round */
+	struct suit_config {
+		std::uint64_t bits; /**< Round r in byte 7 - r, so that the order of integers is that of the rounds */
+
+		inline unsigned int get(unsigned int r) const
+		{
+			return static_cast<unsigned int>(bits >> (56 - 8 * r) & 0xFF);
+		}
+
+		inline void set(unsigned int r, unsigned int n)
+		{
+			bits = (bits & ~(0xFFull << (56 - 8 * r))) | static_cast<std::uint64_t>(n) << (56 - 8 * r);
+		}
+
+		bool operator==(suit_config const& rop) const
+		{
+			return bits == rop.bits;
+		}
+
+		bool operator<(suit_config const& rop) const
+		{
+			return bits < rop.bits;
+		}
+	};
+
+	/** The suit configurations of a hand, sorted, and its range of indices */
+	struct configuration {
+		suit_config suits[4];
+		std::uint64_t size;
+		std::uint64_t offset;
+
+		bool operator<(configuration const& rop) const
+		{
+			return std::lexicographical_compare(suits, suits + 4, rop.suits, rop.suits + 4);
+		}
+	};
+
+	/** Add every sorted configuration of the rounds up to round */
+	void enumerate(unsigned int round, unsigned int r, unsigned int s, suit_config *counts)
+	{
+		if (r > round) {
+			for (unsigned int i = 1; i < 4; ++i) {
+				if (counts[i - 1] < counts[i]) {
+					return;
+				}
+			}
+			configuration c{};
+			std::copy(counts, counts + 4, c.suits);
+			c.size = 1;
+			for (unsigned int i = 0; i < 4;) {
+				unsigned int j = i + 1;
+				while (j < 4 && counts[j] == counts[i]) {
+					++j;
+				}
+				c.size *= detail::choose(suit_size(counts[i], round + 1) + (j - i) - 1, j - i);
+				i = j;
+			}
+			configs[round].push_back(c);
+			return;
+		}
+		unsigned int dealt = 0;
+		for (unsigned int t = 0; t < s; ++t) {
+			dealt += counts[t].get(r);
+		}
+		if (s == 3) {
+			const unsigned int n = cards[r] - dealt;
+			if (n + cards_of(counts[3], r) <= 13) {
+				counts[3].set(r, n);
+				enumerate(round, r + 1, 0, counts);
+				counts[3].set(r, 0);
+			}
+			return;
+		}
+		for (unsigned int n = 0; n + dealt <= cards[r] && n + cards_of(counts[s], r) <= 13; ++n) {
+			counts[s].set(r, n);
+			enumerate(round, r, s + 1, counts);
+		}
+		counts[s].set(r, 0);
+	}
+
+	/** @return The cards of a suit in the rounds before r */
+	static unsigned int cards_of(suit_config const& c, unsigned int r)
+	{
+		unsigned int n = 0;
+		for (unsigned int i = 0; i < r; ++i) {
+			n += c.get(i);
+		}
+		return n;
+	}
+
+	/** @return The number of ways to hold the ranks of one suit of a configuration */
+	static std::uint64_t suit_size(suit_config const& c, unsigned int count)
+	{
+		std::uint64_t size = 1;
+		unsigned int used = 0;
+		for (unsigned int r = 0; r < count; ++r) {
+			size *= detail::choose(13 - used, c.get(r));
+			used += c.get(r);
+		}
+		return size;
+	}
+
+	/** @return The index of the rank sets of one suit among suit_size() */
+	static std::uint64_t suit_index(std::uint16_t const *ranks, suit_config const& c, unsigned int count)
+	{
+		std::uint64_t idx = 0;
+		std::uint64_t mult = 1;
+		std::uint16_t used = 0;
+		unsigned int used_count = 0;
+		for (unsigned int r = 0; r < count; ++r) {
+			idx += mult * detail::colex_rank(ranks[r], used);
+			mult *= detail::choose(13 - used_count, c.get(r));
+			used |= ranks[r];
+			used_count += c.get(r);
+		}
+		return idx;
+	}
+
+	/** The rank sets of one suit of an index (the inverse of suit_index) */
+	static void suit_ranks(std::uint64_t idx, suit_config const& c, unsigned int count, std::uint16_t *ranks)
+	{
+		std::uint16_t used = 0;
+		unsigned int used_count = 0;
+		for (unsigned int r = 0; r < count; ++r) {
+			const std::uint64_t n = detail::choose(13 - used_count, c.get(r));
+			ranks[r] = detail::expand_ranks(detail::colex_unrank(idx % n, c.get(r)), used);
+			idx /= n;
+			used |= ranks[r];
+			used_count += c.get(r);
+		}
+	}
+
+	configuration const& find(unsigned int round, suit_config const *sorted) const
+	{
+		std::vector<configuration> const& list = configs[round];
+		configuration c{};
+		std::copy(sorted, sorted + 4, c.suits);
+		auto it = std::lower_bound(list.begin(), list.end(), c);
+		if (it != list.end() && std::equal(sorted, sorted + 4, it->suits)) {
+			return *it;
+		}
+		throw std::logic_error("No configuration of the hand indexer");
+	}
+
+	std::vector<unsigned int> cards; /**< The number of cards of each round */
+	std::vector<std::vector<configuration>> configs; /**< The configurations of each round, sorted */
+	std::vector<std::uint64_t> sizes; /**< The number of classes up to each round */
+};
+
+} // namespace pk
+#endif // ISOMORPHISM_H_
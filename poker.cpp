@@ -0,0 +1,245 @@
+/* poker.cpp Copyright 2019, 2023 TNPLR
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "poker.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <ostream>
+#include <random>
+
+namespace pk {
+
+std::ostream& operator<<(std::ostream& os, const card& cd)
+{
+	switch (cd.number) {
+		case 14:
+			os << cd.card_rank();
+			return os;
+		default:
+			os << cd.suit_sign() << ' ' << std::setw(2) << cd.card_rank();
+			return os;
+	};
+}
+
+std::ostream& operator<<(std::ostream& os, poker const& pk)
+{
+	os << pk.pile;
+	return os;
+}
+
+std::ostream& operator<<(std::ostream &os, const deck& dk)
+{
+	return (dk.*dk.output_stream)(os);
+}
+
+std::ostream& deck::no_sort_ostream(std::ostream &os) const
+{
+	if (empty()) {
+		return os;
+	}
+	os << (*this)[0];
+	for (unsigned int i = 1; i < size(); ++i) {
+		os << "  " << (*this)[i];
+	}
+	return os;
+}
+
+card deck::remove(card const& c, remove_mode mode)
+{
+	auto it = std::find(pile.begin(), pile.end(), c);
+	if (it == pile.end()) {
+		throw std::invalid_argument("He or she does not have the card");
+	}
+	if (mode == remove_mode::unordered) {
+		*it = pile.back();
+		pile.pop_back();
+	} else {
+		pile.erase(it);
+	}
+	return c;
+}
+
+std::ostream& deck::sort_by_number_ostream(std::ostream &os) const
+{
+	// Count the cards instead of sorting a copy, then print in the order of sort()
+	size_t count[16][4]{};
+	for (card const& crd : pile) {
+		++count[crd.number][crd.suit];
+	}
+	bool first = true;
+	for (unsigned char number : number_order) {
+		for (int suit = SPADE; suit >= CLUB; --suit) {
+			for (size_t n = count[number][suit]; n > 0; --n) {
+				if (!first) {
+					os << "  ";
+				}
+				os << card{static_cast<unsigned short>(suit), number};
+				first = false;
+			}
+		}
+	}
+	return os;
+}
+
+std::ostream& deck::rank_only_ostream(std::ostream &os) const
+{
+	std::for_each(pile.cbegin(), pile.cend(), [&os](card const& crd) -> void {
+			os << crd.card_rank() << ' ';
+	});
+	return os;
+}
+
+std::ostream& deck::sort_by_suit_ostream(std::ostream &os) const
+{
+	for (int i = SPADE; i >= CLUB; --i) {
+		os << card::suit_image[i] << "  ";
+		for (card const& crd : pile) {
+			if (crd.suit == i) {
+				os << crd.card_rank() << ' ';
+			}
+		}
+		os << "\n";
+	}
+	return os;
+}
+
+deck deck::suit_subdeck(int suit) const
+{
+	deck dktmp;
+	std::for_each(pile.cbegin(), pile.cend(), [=, &dktmp](card const& crd) -> void {
+			if (crd.suit == suit) {
+				dktmp.push_back(crd);
+			}
+	});
+	return dktmp;
+}
+
+void deck::sort(sort_mode mode)
+{
+	PK_PROBE(sort);
+	// Counting sort: there are only 16 x 4 distinct cards, and equal cards are identical
+	size_t count[16][4]{};
+	for (card const& crd : pile) {
+		++count[crd.number][crd.suit];
+	}
+	auto it = pile.begin();
+	switch (mode)
+	{
+	case sort_mode::rank_first_descending:
+		for (unsigned char number : number_order) {
+			for (int suit = SPADE; suit >= CLUB; --suit) {
+				it = std::fill_n(it, count[number][suit], card{static_cast<unsigned short>(suit), number});
+			}
+		}
+		return;
+	case sort_mode::suit_first_descending:
+		for (int suit = SPADE; suit >= CLUB; --suit) {
+			for (unsigned char number : number_order) {
+				it = std::fill_n(it, count[number][suit], card{static_cast<unsigned short>(suit), number});
+			}
+		}
+		return;
+	default:
+		return;
+	}
+}
+
+void poker::sort_player_card()
+{
+	std::for_each(player_card.begin(), player_card.end(), [](deck& tmp) {
+		tmp.sort();
+	});
+}
+
+poker::poker(unsigned int deck, unsigned int player, bool joker, std::pmr::memory_resource *resource)
+	: players{player}, decks{deck}, joker{joker}, pile{resource}, player_card{resource}
+{
+	if (player == 0) {
+		throw std::invalid_argument("Argument \'player\' cannot be zero");
+	}
+
+	const size_t total = deck * (joker ? 54u : 52u);
+	pile.reserve(total);
+	player_card.reserve(players);
+	for (unsigned int i = 0; i < players; ++i) {
+		player_card.emplace_back();
+	}
+	reset();
+}
+
+void poker::reset()
+{
+	pile.clear();
+	for (unsigned int k = 0; k < decks; ++k) {
+		for (unsigned char i = 0; i < 4; ++i) {
+			for (unsigned char j = 1; j <= 13; ++j) {
+				pile.push_back(card{i, j});
+			}
+		}
+		if (joker) {
+			pile.push_back(card{1,14});
+			pile.push_back(card{1,14});
+		}
+	}
+
+	for (deck& hand : player_card) {
+		hand.clear();
+	}
+}
+
+void poker::shuffle(unsigned int time)
+{
+#if unix
+	std::random_device rd;
+	std::mt19937_64 generator(rd());
+#elif __WIN32 || __WINNT
+	std::mt19937_64 generator(::time(0));
+#else
+	std::random_device rd;
+	std::mt19937_64 generator(rd());
+#endif // unix
+	shuffle(generator, shuffle_mode::random_swap, time);
+}
+
+void poker::play(unsigned int player_no, card const& c, deck::remove_mode mode)
+{
+	PK_PROBE(play);
+	if (player_no >= players) {
+		throw std::out_of_range("The player number is too large");
+	}
+	player_card[player_no].remove(c, mode);
+}
+
+void poker::deal(unsigned int card_per_person)
+{
+	PK_PROBE(deal);
+	unsigned int player_no{0};
+	card_per_person *= players;
+	for (unsigned int card_count = 0; card_count < card_per_person; ++card_count) {
+		player_card[player_no].push_back(pile.back());
+		pile.pop_back();
+		if (++player_no >= players) {
+			player_no = 0;
+		}
+	}
+}
+
+template void poker::shuffle<std::mt19937_64>(std::mt19937_64&, shuffle_mode, unsigned int);
+template void poker::shuffle<std::mt19937>(std::mt19937&, shuffle_mode, unsigned int);
+template void poker::shuffle<xoshiro256ss>(xoshiro256ss&, shuffle_mode, unsigned int);
+template void poker::shuffle<pcg64>(pcg64&, shuffle_mode, unsigned int);
+template void poker::shuffle<philox4x32>(philox4x32&, shuffle_mode, unsigned int);
+
+} // namespace pk
@@ -23,10 +23,15 @@
 #include <string>
 #include <cstdint>
 #include <vector>
+#include <memory_resource>
 #include <random>
 #include <iomanip>
 #include <stdexcept>
 #include <algorithm>
+#include <type_traits>
+
+#include "instrument.h"
+#include "rng.h"
 
 namespace pk {
 /**
@@ -76,7 +81,7 @@ struct card {
 	char const* suit_sign() const;
 	/** Get the rank of card (string) */
 	char const* card_rank() const;
-	bool operator==(card const& rop)
+	bool operator==(card const& rop) const
 	{
 		return number == rop.number && suit == rop.suit;
 	}
@@ -91,27 +96,83 @@ struct card {
 	 */
 	static constexpr const char *const suit_image[4]{"\x5", "\x4", "\x3", "\x6"};
 #endif // unix
-	static constexpr char const * const cardname[15]{"", "A", "2", "3", "4", "5", "6", "7", "8", "9", "10", "J", "Q", "K", "JOKER"};
+	static constexpr char const * const cardname[16]{"", "A", "2", "3", "4", "5", "6", "7", "8", "9", "10", "J", "Q", "K", "JOKER", "?"};
 };
 
-char const* card::suit_sign() const
+inline char const* card::suit_sign() const
 {
 	return suit_image[suit];
 }
 
-char const* card::card_rank() const
+inline char const* card::card_rank() const
 {
 	return cardname[number];
 }
 
 
+/**
+ * A deck of cards
+ * The storage comes from a std::pmr::memory_resource, e.g. an arena of a table:
+ *     std::pmr::monotonic_buffer_resource arena;
+ *     pk::deck dk{&arena};
+ */
 class deck {
 public:
+	using allocator_type = std::pmr::polymorphic_allocator<card>;
+
+	deck() = default;
+	deck(deck const&) = default;
+	deck(deck&&) = default;
+	deck& operator=(deck const&) = default;
+	deck& operator=(deck&&) = default;
+
+	/** An empty deck with storage from an allocator
+	 * @param alloc The allocator (or a std::pmr::memory_resource *)
+	 */
+	explicit deck(allocator_type alloc) : pile(alloc) {}
+
+	/** Copy a deck into storage from an allocator
+	 * @param dk The deck to copy
+	 * @param alloc The allocator
+	 */
+	deck(deck const& dk, allocator_type alloc) : output_stream{dk.output_stream}, pile(dk.pile, alloc) {}
+
+	/** Move a deck into storage from an allocator
+	 * @param dk The deck to move
+	 * @param alloc The allocator
+	 */
+	deck(deck&& dk, allocator_type alloc) : output_stream{dk.output_stream}, pile(std::move(dk.pile), alloc) {}
+
+	/** @return The allocator of the storage */
+	inline allocator_type get_allocator() const
+	{
+		return pile.get_allocator();
+	}
+
+	/** This enumerator is the mode of removing a card */
+	enum class remove_mode {
+		stable, /**< Keep the order of the other cards */
+		unordered, /**< Move the last card into the hole (swap-and-pop), no shifting */
+	};
+
 	/** Remove the card which is identical to c from the deck
 	 * @param c Card to remove
+	 * @param mode The mode of removing. Default to stable.
 	 * @return The card that is removed (i.e. c)
 	*/
-	card remove(card const& c);
+	card remove(card const& c, remove_mode mode = remove_mode::stable);
+
+	/** @return The number of cards identical to c in the deck, in O(n); see indexed_deck for O(1) */
+	inline size_t count(card const& c) const
+	{
+		return static_cast<size_t>(std::count(pile.cbegin(), pile.cend(), c));
+	}
+
+	/** @return Return true if the deck has a card identical to c, in O(n); see indexed_deck for O(1) */
+	inline bool contains(card const& c) const
+	{
+		return std::find(pile.cbegin(), pile.cend(), c) != pile.cend();
+	}
 
 	/** Put a card into the deck
 	 * @param c Card to put into
@@ -127,6 +188,35 @@ public:
 		pile.pop_back();
 	}
 
+	/** Remove every card in the deck, keeping the storage */
+	inline void clear(void)
+	{
+		pile.clear();
+	}
+
+	/** Reserve storage, so that the deck can hold n cards without allocation
+	 * @param n The number of cards
+	 */
+	inline void reserve(size_t n)
+	{
+		pile.reserve(n);
+	}
+
+	/** Replace the cards of the deck by a range, reusing the storage
+	 * @param first The first card
+	 * @param last One past the last card
+	 */
+	inline void assign(card const *first, card const *last)
+	{
+		pile.assign(first, last);
+	}
+
+	/** @return The cards of the deck, size() of them */
+	inline card const *data() const
+	{
+		return pile.data();
+	}
+
 	/** @return The size of the deck */
 	inline size_t size(void) const
 	{
@@ -214,9 +304,14 @@ public:
 	 */
 	deck suit_subdeck(int suit) const;
 private:
+	/** Card numbers in the descending order of sort(): Ace, then every number above King
+	 * from 15 (representable, though no card has it) down to Joker, then King ... Two, None
+	 */
+	static constexpr unsigned char number_order[16]{1, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 0};
+
 	mutable std::ostream& (deck::*output_stream)(std::ostream &os) const = &deck::no_sort_ostream;
 
-	std::vector<struct card> pile; /**< Internal storage of cards */
+	std::pmr::vector<struct card> pile; /**< Internal storage of cards */
 
 	std::ostream& no_sort_ostream(std::ostream &os) const;
 	std::ostream& sort_by_number_ostream(std::ostream &os) const;
@@ -224,6 +319,546 @@ private:
 	std::ostream& sort_by_suit_ostream(std::ostream &os) const;
 };
 
+namespace detail {
+/** @return The number of set bits in x */
+constexpr unsigned int popcount64(std::uint64_t x)
+{
+#if __GNUC__
+	return static_cast<unsigned int>(__builtin_popcountll(x));
+#else
+	unsigned int n = 0;
+	for (; x; x &= x - 1) {
+		++n;
+	}
+	return n;
+#endif // __GNUC__
+}
+
+/** @return The index of the lowest set bit of x. x must not be zero. */
+constexpr unsigned int ctz64(std::uint64_t x)
+{
+#if __GNUC__
+	return static_cast<unsigned int>(__builtin_ctzll(x));
+#else
+	unsigned int n = 0;
+	for (; !(x & 1); x >>= 1) {
+		++n;
+	}
+	return n;
+#endif // __GNUC__
+}
+
+/** @return The number of leading zero bits of x. x must not be zero. */
+constexpr unsigned int clz64(std::uint64_t x)
+{
+#if __GNUC__
+	return static_cast<unsigned int>(__builtin_clzll(x));
+#else
+	unsigned int n = 0;
+	for (; !(x >> 63); x <<= 1) {
+		++n;
+	}
+	return n;
+#endif // __GNUC__
+}
+
+/** Draw an integer uniformly distributed in [0, range)
+ * Lemire's nearly divisionless method: a 32x32 multiply, and a modulo only on the rare rejection path.
+ * @param generator A uniform random bit generator with at least 32 random bits
+ * @param range The upper bound (exclusive). Must not be zero.
+ */
+template <class URBG>
+inline std::uint32_t bounded_rand(URBG& generator, std::uint32_t range)
+{
+	static_assert(URBG::min() == 0 && URBG::max() >= 0xFFFFFFFFu, "The generator must give at least 32 random bits");
+	std::uint64_t m = static_cast<std::uint64_t>(static_cast<std::uint32_t>(generator())) * range;
+	std::uint32_t l = static_cast<std::uint32_t>(m);
+	if (l < range) {
+		std::uint32_t t = -range % range;
+		while (l < t) {
+			m = static_cast<std::uint64_t>(static_cast<std::uint32_t>(generator())) * range;
+			l = static_cast<std::uint32_t>(m);
+		}
+	}
+	return static_cast<std::uint32_t>(m >> 32);
+}
+} // namespace detail
+
+/**
+ * A set of cards from a single deck, packed into a 64-bit mask
+ * Each suit owns a 16-bit lane (bit suit * 16), in which bit 0 - 12 are Two to Ace.
+ * The two jokers use the spare bits 13 and 14 of the club lane.
+ * Every operation is O(1). Since it is a set, a card can be held at most once.
+ */
+class card_set {
+public:
+	/** All 52 cards without jokers */
+	static constexpr std::uint64_t full_deck = 0x1FFF1FFF1FFF1FFFull;
+	/** The bits of the two jokers */
+	static constexpr std::uint64_t joker_mask = 0x6000ull;
+
+	/** An empty set */
+	constexpr card_set() : bits{0} {}
+
+	/** A set from a raw mask
+	 * @param mask The mask in the layout described above
+	 */
+	constexpr explicit card_set(std::uint64_t mask) : bits{mask} {}
+
+	/** A set from the cards of a deck. Duplicated cards are kept once.
+	 * @param dk The deck
+	 */
+	explicit card_set(deck const& dk) : bits{0}
+	{
+		for (unsigned int i = 0; i < dk.size(); ++i) {
+			insert(dk[i]);
+		}
+	}
+
+	/** @return A set of a whole deck
+	 * @param joker Whether the two jokers are included. Default to false.
+	 */
+	static constexpr card_set full(bool joker = false)
+	{
+		return card_set{joker ? full_deck | joker_mask : full_deck};
+	}
+
+	/** @return The rank index of a card number. 0 - 12 are Two to Ace.
+	 * @param number The number of the card (1 - 13)
+	 */
+	static constexpr unsigned int rank_index(unsigned int number)
+	{
+		return (number + 11) % 13;
+	}
+
+	/** @return The bit index of a card (not a joker) */
+	static constexpr unsigned int index(card const& c)
+	{
+		return c.suit * 16u + rank_index(c.number);
+	}
+
+	/** @return The card of a bit index */
+	static card to_card(unsigned int index)
+	{
+		if ((1ull << index) & joker_mask) {
+			return card{1, 14};
+		}
+		return card{static_cast<unsigned short>(index / 16), static_cast<unsigned short>((index % 16 + 1) % 13 + 1)};
+	}
+
+	/** Put a card into the set. Empty cards (number 0) are ignored.
+	 * @param c Card to put into
+	 */
+	inline void insert(card const& c)
+	{
+		if (c.number == 14) {
+			bits |= (bits & (1ull << 13)) ? 1ull << 14 : 1ull << 13;
+		} else if (c.number != 0) {
+			bits |= 1ull << index(c);
+		}
+	}
+
+	/** Remove a card from the set. It has no effect if the set does not have the card.
+	 * @param c Card to remove
+	 */
+	inline void remove(card const& c)
+	{
+		if (c.number == 14) {
+			bits &= ~((bits & (1ull << 14)) ? 1ull << 14 : 1ull << 13);
+		} else if (c.number != 0) {
+			bits &= ~(1ull << index(c));
+		}
+	}
+
+	/** @return Return true if the set has the card */
+	inline bool contains(card const& c) const
+	{
+		if (c.number == 14) {
+			return bits & joker_mask;
+		}
+		return c.number != 0 && (bits >> index(c) & 1);
+	}
+
+	/** @return The 13-bit rank mask (bit 0 - 12 are Two to Ace) of a suit
+	 * @param suit the suit (enumerator)
+	 */
+	inline std::uint16_t suit_mask(int suit) const
+	{
+		return static_cast<std::uint16_t>(bits >> (suit * 16) & 0x1FFF);
+	}
+
+	/** @return The subset of a specific suit
+	 * @param suit the suit (enumerator)
+	 */
+	inline card_set suit_subset(int suit) const
+	{
+		return card_set{bits & (0x1FFFull << (suit * 16))};
+	}
+
+	/** @return The number of cards in the set */
+	inline unsigned int size() const
+	{
+		return detail::popcount64(bits);
+	}
+
+	/** @return Return true if the set is empty */
+	inline bool empty() const
+	{
+		return bits == 0;
+	}
+
+	/** @return The raw mask */
+	constexpr std::uint64_t mask() const
+	{
+		return bits;
+	}
+
+	/** @return A deck of the cards, from the lowest bit to the highest */
+	deck to_deck() const
+	{
+		deck dk;
+		for (std::uint64_t rest = bits; rest; rest &= rest - 1) {
+			dk.push_back(to_card(detail::ctz64(rest)));
+		}
+		return dk;
+	}
+
+	inline card_set operator&(card_set rop) const { return card_set{bits & rop.bits}; }
+	inline card_set operator|(card_set rop) const { return card_set{bits | rop.bits}; }
+	inline card_set operator^(card_set rop) const { return card_set{bits ^ rop.bits}; }
+	/** @return The cards in this set but not in rop */
+	inline card_set operator-(card_set rop) const { return card_set{bits & ~rop.bits}; }
+	inline card_set& operator&=(card_set rop) { bits &= rop.bits; return *this; }
+	inline card_set& operator|=(card_set rop) { bits |= rop.bits; return *this; }
+	inline card_set& operator^=(card_set rop) { bits ^= rop.bits; return *this; }
+	inline card_set& operator-=(card_set rop) { bits &= ~rop.bits; return *this; }
+	inline bool operator==(card_set rop) const { return bits == rop.bits; }
+	inline bool operator!=(card_set rop) const { return bits != rop.bits; }
+
+private:
+	std::uint64_t bits; /**< Internal storage of cards */
+};
+
+/**
+ * A deck with an index from each card to its positions
+ * For shoes of many decks: count, contains and unordered remove are O(1), however
+ * many duplicates the deck holds. Each card (suit * 16 + number) has a doubly
+ * linked list of its positions, threaded through two arrays parallel to the cards.
+ * E.g.
+ *     pk::indexed_deck shoe{game.card_pile()};
+ *     shoe.remove(c, pk::deck::remove_mode::unordered);
+ */
+class indexed_deck {
+public:
+	/** An empty deck */
+	indexed_deck()
+	{
+		std::fill(std::begin(head), std::end(head), npos);
+	}
+
+	/** A deck of the cards of dk, in the same order
+	 * @param dk The deck
+	 */
+	explicit indexed_deck(deck const& dk) : indexed_deck()
+	{
+		reserve(dk.size());
+		for (unsigned int i = 0; i < dk.size(); ++i) {
+			push_back(dk[i]);
+		}
+	}
+
+	/** Put a card into the deck
+	 * @param c Card to put into
+	 */
+	inline void push_back(card c)
+	{
+		const std::uint32_t pos = static_cast<std::uint32_t>(pile.size());
+		pile.push_back(c);
+		next.push_back(npos);
+		prev.push_back(npos);
+		link(pos);
+	}
+
+	/** Remove the last card in the deck*/
+	inline void pop_back(void)
+	{
+		unlink(static_cast<std::uint32_t>(pile.size() - 1));
+		pile.pop_back();
+		next.pop_back();
+		prev.pop_back();
+	}
+
+	/** Remove the card which is identical to c from the deck
+	 * @param c Card to remove
+	 * @param mode The mode of removing. unordered is O(1) and takes any copy of c; stable is O(n),
+	 * takes the first copy and leaves the cards as deck::remove would. Default to unordered.
+	 * @return The card that is removed (i.e. c)
+	 */
+	card remove(card const& c, deck::remove_mode mode = deck::remove_mode::unordered)
+	{
+		if (!contains(c)) {
+			throw std::invalid_argument("He or she does not have the card");
+		}
+		if (mode == deck::remove_mode::stable) {
+			// deck::remove takes out the first position of c
+			std::uint32_t hole = head[key(c)];
+			for (std::uint32_t pos = next[hole]; pos != npos; pos = next[pos]) {
+				hole = pos < hole ? pos : hole;
+			}
+			unlink(hole);
+			pile.remove(c);
+			next.erase(next.begin() + hole);
+			prev.erase(prev.begin() + hole);
+			// Every later position moves down by one; the lists keep their order
+			auto shift = [hole](std::uint32_t& pos) {
+				pos -= pos != npos && pos > hole;
+			};
+			std::for_each(next.begin(), next.end(), shift);
+			std::for_each(prev.begin(), prev.end(), shift);
+			std::for_each(std::begin(head), std::end(head), shift);
+			return c;
+		}
+		const std::uint32_t hole = head[key(c)];
+		const std::uint32_t last = static_cast<std::uint32_t>(pile.size() - 1);
+		unlink(hole);
+		if (hole != last) {
+			unlink(last);
+			pile[hole] = pile[last];
+			link(hole);
+		}
+		pile.pop_back();
+		next.pop_back();
+		prev.pop_back();
+		return c;
+	}
+
+	/** @return The number of cards identical to c in the deck */
+	inline size_t count(card const& c) const
+	{
+		return multiplicity[key(c)];
+	}
+
+	/** @return Return true if the deck has a card identical to c */
+	inline bool contains(card const& c) const
+	{
+		return multiplicity[key(c)] != 0;
+	}
+
+	/** Remove every card in the deck, keeping the storage */
+	inline void clear(void)
+	{
+		pile.clear();
+		next.clear();
+		prev.clear();
+		std::fill(std::begin(head), std::end(head), npos);
+		std::fill(std::begin(multiplicity), std::end(multiplicity), 0);
+	}
+
+	/** Reserve storage, so that the deck can hold n cards without allocation
+	 * @param n The number of cards
+	 */
+	inline void reserve(size_t n)
+	{
+		pile.reserve(n);
+		next.reserve(n);
+		prev.reserve(n);
+	}
+
+	/** @return The size of the deck */
+	inline size_t size(void) const
+	{
+		return pile.size();
+	}
+
+	/** @return Return true if the deck is empty. (i.e. this->size() == 0) */
+	inline bool empty(void) const
+	{
+		return pile.empty();
+	}
+
+	/** @return The last card in the deck*/
+	inline struct card const& back() const
+	{
+		return pile[static_cast<unsigned int>(pile.size() - 1)];
+	}
+
+	/** The indexth element of the deck
+	 * @return A const reference of the card
+	 */
+	inline const struct card& operator[](unsigned int index) const
+	{
+		return pile[index];
+	}
+
+	/** @return The cards as a plain deck */
+	inline deck const& cards() const
+	{
+		return pile;
+	}
+
+private:
+	static constexpr std::uint32_t npos = 0xFFFFFFFFu;
+
+	static inline unsigned int key(card const& c)
+	{
+		return c.suit * 16u + c.number;
+	}
+
+	/** Put position pos at the front of the list of its card */
+	inline void link(std::uint32_t pos)
+	{
+		const unsigned int k = key(pile[pos]);
+		next[pos] = head[k];
+		prev[pos] = npos;
+		if (head[k] != npos) {
+			prev[head[k]] = pos;
+		}
+		head[k] = pos;
+		++multiplicity[k];
+	}
+
+	/** Take position pos out of the list of its card */
+	inline void unlink(std::uint32_t pos)
+	{
+		const unsigned int k = key(pile[pos]);
+		if (prev[pos] != npos) {
+			next[prev[pos]] = next[pos];
+		} else {
+			head[k] = next[pos];
+		}
+		if (next[pos] != npos) {
+			prev[next[pos]] = prev[pos];
+		}
+		--multiplicity[k];
+	}
+
+	deck pile; /**< The cards */
+	std::vector<std::uint32_t> next; /**< The next position of the same card */
+	std::vector<std::uint32_t> prev; /**< The previous position of the same card */
+	std::uint32_t head[64]; /**< The first position of each card */
+	std::uint32_t multiplicity[64]{}; /**< The number of each card */
+};
+
+/**
+ * A hand of at most N cards, stored inline
+ * It never allocates, so it can be dealt into over and over with no heap traffic.
+ */
+template <std::size_t N>
+class fixed_hand {
+public:
+	/** Put a card into the hand
+	 * @param c Card to put into
+	 */
+	inline void push_back(card c)
+	{
+		if (count == N) {
+			throw std::length_error("The hand is full");
+		}
+		cards[count++] = c;
+	}
+
+	/** Remove the last card in the hand*/
+	inline void pop_back(void)
+	{
+		--count;
+	}
+
+	/** Remove the card which is identical to c from the hand
+	 * @param c Card to remove
+	 * @return The card that is removed (i.e. c)
+	 */
+	card remove(card const& c)
+	{
+		card *it = std::find(cards, cards + count, c);
+		if (it == cards + count) {
+			throw std::invalid_argument("He or she does not have the card");
+		}
+		std::copy(it + 1, cards + count, it);
+		--count;
+		return c;
+	}
+
+	/** Remove every card in the hand */
+	inline void clear(void)
+	{
+		count = 0;
+	}
+
+	/** @return The size of the hand */
+	inline size_t size(void) const
+	{
+		return count;
+	}
+
+	/** @return The most cards the hand can hold (i.e. N) */
+	static constexpr size_t capacity(void)
+	{
+		return N;
+	}
+
+	/** @return Return true if the hand is empty. (i.e. this->size() == 0) */
+	inline bool empty(void) const
+	{
+		return count == 0;
+	}
+
+	/** @return The last card in the hand*/
+	inline struct card& back()
+	{
+		return cards[count - 1];
+	}
+
+	/** The indexth element of the hand
+	 * @return A reference of the card
+	 */
+	inline struct card& operator[](unsigned int index)
+	{
+		return cards[index];
+	}
+
+	/** The indexth element of the hand (for const hand)
+	 * @return A const reference of the card
+	 */
+	inline const struct card& operator[](unsigned int index) const
+	{
+		return cards[index];
+	}
+
+	inline card *begin() { return cards; }
+	inline card *end() { return cards + count; }
+	inline card const *begin() const { return cards; }
+	inline card const *end() const { return cards + count; }
+
+	/** @return The cards of the hand as a card_set */
+	inline card_set to_card_set() const
+	{
+		card_set cs;
+		for (size_t i = 0; i < count; ++i) {
+			cs.insert(cards[i]);
+		}
+		return cs;
+	}
+
+	/** Output the hand like a deck in no_sort mode
+	 * @param os The output stream
+	 * @param hd The hand to output
+	 */
+	friend std::ostream& operator<<(std::ostream& os, fixed_hand const& hd)
+	{
+		for (size_t i = 0; i < hd.count; ++i) {
+			if (i) {
+				os << "  ";
+			}
+			os << hd.cards[i];
+		}
+		return os;
+	}
+
+private:
+	card cards[N]; /**< Internal storage of cards */
+	size_t count = 0; /**< The number of cards */
+};
+
 class poker {
 public:
 	// Default 1 Deck (52 cards and 2 persons)
@@ -231,14 +866,38 @@ public:
 	 * @param deck The number of decks to put into the card pile. Default to 1.
 	 * @param player The player of the poker game. Default to 2.
 	 * @param joker Whether the jokers should be put into the pile. Default to false.
+	 * @param resource The memory resource of the pile and every hand. Default to the default resource.
+	 * E.g. cards of a table from an arena, freed at once when the table closes:
+	 *     std::pmr::monotonic_buffer_resource arena;
+	 *     pk::poker table(1, 6, false, &arena);
 	 */
-	explicit poker(unsigned int deck = 1, unsigned int player = 2, bool joker = false);
+	explicit poker(unsigned int deck = 1, unsigned int player = 2, bool joker = false,
+		std::pmr::memory_resource *resource = std::pmr::get_default_resource());
+
+	/** This enumerator is the mode of shuffling */
+	enum class shuffle_mode {
+		random_swap, /**< Swap two random cards for a number of times */
+		fisher_yates, /**< Single pass Fisher-Yates shuffle, gives a uniform permutation */
+	};
 
 	/** Shuffle the card pile
 	 * @param time The time to shuffle the card. Default to 1000
 	 */
 	void shuffle(unsigned int time = 1000);
 
+	/** Shuffle the card pile with a caller-owned random engine
+	 * The engine is never reseeded, so it may be seeded once per thread and reused for every shuffle.
+	 * E.g.
+	 *     std::mt19937_64 generator(seed);
+	 *     game.shuffle(generator);
+	 * Faster engines (xoshiro256**, PCG64, Philox) are provided in rng.h.
+	 * @param generator A uniform random bit generator with at least 32 random bits
+	 * @param mode The mode of shuffling. Default to Fisher-Yates.
+	 * @param time The time to swap cards in random_swap mode. Default to 1000
+	 */
+	template <class URBG, typename = std::enable_if_t<!std::is_arithmetic<URBG>::value>>
+	void shuffle(URBG& generator, shuffle_mode mode = shuffle_mode::fisher_yates, unsigned int time = 1000);
+
 	/** Draw a card from the pile to the player.
 	 * @param player_no The number of the player.
 	 * @return The card drawed by the function.
@@ -248,21 +907,98 @@ public:
 	/** Play a card from the player to the card pile.
 	 * @param player_no The number of the player.
 	 * @param card The card in the player's deck
+	 * @param mode The mode of removing the card from the player's deck. Default to stable.
 	 */
-	void play(unsigned int player_no, card const& c);
+	void play(unsigned int player_no, card const& c, deck::remove_mode mode = deck::remove_mode::stable);
 
 	/** Deal some card to each person.
 	 * @param card_per_person How many card should the function deal to each player.
 	 */
 	void deal(unsigned int card_per_person);
 
+	/** Draw a card from the pile into a caller-owned hand.
+	 * @param hand The hand to draw into
+	 * @return The card drawed by the function.
+	 */
+	template <std::size_t N>
+	struct card draw(fixed_hand<N>& hand);
+
+	/** Deal some card to each person, into caller-owned hands rather than the hands of the game.
+	 * E.g.
+	 *     pk::fixed_hand<2> hole[9];
+	 *     game.deal(2, hole);
+	 * @param card_per_person How many card should the function deal to each player.
+	 * @param hands An array of one hand per player
+	 */
+	template <std::size_t N>
+	void deal(unsigned int card_per_person, fixed_hand<N> *hands);
+
+	/** Draw a random card of the pile to the player: one step of a Fisher-Yates shuffle.
+	 * Drawing this way from a pile in any order gives the cards a full shuffle would, for a cost
+	 * proportional to the cards drawn rather than to the pile. E.g. a shoe of 8 decks:
+	 *     pk::poker shoe(8, 7);
+	 *     shoe.set_penetration(0.75);
+	 *     ...
+	 *     if (shoe.needs_reshuffle()) {
+	 *         shoe.reset();
+	 *     }
+	 *     shoe.deal(2, generator);
+	 * @param player_no The number of the player.
+	 * @param generator A uniform random bit generator with at least 32 random bits
+	 * @return The card drawed by the function.
+	 */
+	template <class URBG, typename = typename URBG::result_type>
+	struct card draw(unsigned int player_no, URBG& generator);
+
+	/** Deal some random card of the pile to each person, see draw(player_no, generator).
+	 * @param card_per_person How many card should the function deal to each player.
+	 * @param generator A uniform random bit generator with at least 32 random bits
+	 */
+	template <class URBG, typename = typename URBG::result_type>
+	void deal(unsigned int card_per_person, URBG& generator);
+
+	/** Place the cut card of a shoe
+	 * @param fraction The fraction of the full pile dealt before the cut card, in [0, 1]. Default to 1, no cut card.
+	 */
+	void set_penetration(double fraction = 1.0)
+	{
+		if (!(fraction >= 0.0 && fraction <= 1.0)) {
+			throw std::invalid_argument("The penetration must be in [0, 1]");
+		}
+		const unsigned int full = decks * (joker ? 54u : 52u);
+		cut = full - static_cast<unsigned int>(full * fraction + 0.5);
+	}
+
+	/** @return The number of cards left in the pile at the cut card */
+	inline unsigned int cut_card() const
+	{
+		return cut;
+	}
+
+	/** @return Whether the cut card has come out, i.e. the pile should be reset before the next round */
+	inline bool needs_reshuffle() const
+	{
+		return pile.size() <= cut;
+	}
+
+	/** Put every card back into the pile in the initial order and empty every player's hand.
+	 * The storage is reused, so dealing again after a reset does not allocate.
+	 */
+	void reset();
+
 	/** Output the card pile
 	 * E.g.
 	 *     std::cout << NAME_OF_THE_GAME;
 	 * @param os The output stream
 	 * @param pk The poker game card pile to output
 	 */
-	friend std::ostream& operator<<(std::ostream& os, poker pk);
+	friend std::ostream& operator<<(std::ostream& os, poker const& pk);
+
+	/** Decode a game from the binary format of serialize.h */
+	friend std::size_t decode(unsigned char const *buf, std::size_t len, poker& pk);
+
+	/** Save and restore the state of a game, see snapshot.h */
+	friend class poker_snapshot;
 
 	/** Card of number *th player.
 	 * @return A reference of the player's deck
@@ -272,6 +1008,38 @@ public:
 		return player_card[player_no];
 	}
 
+	/** Card of number *th player (for const poker).
+	 * @return A const reference of the player's deck
+	 */
+	deck const& operator[](unsigned int player_no) const
+	{
+		return player_card[player_no];
+	}
+
+	/** @return The card pile, i.e. the cards not held by any player */
+	inline deck const& card_pile() const
+	{
+		return pile;
+	}
+
+	/** @return The number of players */
+	inline unsigned int player_count() const
+	{
+		return players;
+	}
+
+	/** @return The number of decks in the full pile */
+	inline unsigned int deck_count() const
+	{
+		return decks;
+	}
+
+	/** @return Whether the full pile has jokers */
+	inline bool has_joker() const
+	{
+		return joker;
+	}
+
 	/** Sort the cards of every player in rank-first ascending order*/
 	void sort_player_card();
 
@@ -279,195 +1047,115 @@ public:
 
 private:
 	unsigned int players;
+	unsigned int decks; /**< The number of decks in the pile */
+	bool joker; /**< Whether the pile has jokers */
 	deck pile;
-	std::vector<deck> player_card;
+	std::pmr::vector<deck> player_card;
+	unsigned int cut = 0; /**< The cards left in the pile at the cut card */
 }; // class poker
 
-std::ostream& operator<<(std::ostream& os, const card& cd)
+template <class URBG, typename>
+void poker::shuffle(URBG& generator, shuffle_mode mode, unsigned int time)
 {
-	switch (cd.number) {
-		case 14:
-			os << cd.card_rank();
-			return os;
-		default:
-			os << cd.suit_sign() << ' ' << std::setw(2) << cd.card_rank();
-			return os;
-	};
-}
-
-std::ostream& operator<<(std::ostream& os, poker pk)
-{
-	os << pk.pile;
-	return os;
-}
-
-std::ostream& operator<<(std::ostream &os, const deck& dk)
-{
-	return (dk.*dk.output_stream)(os);
-}
-
-std::ostream& deck::no_sort_ostream(std::ostream &os) const
-{
-	if (empty()) {
-		return os;
-	}
-	os << (*this)[0];
-	for (unsigned int i = 1; i < size(); ++i) {
-		os << "  " << (*this)[i];
+	PK_PROBE(shuffle);
+	unsigned int sz = pile.size();
+	if (sz < 2) {
+		return;
 	}
-	return os;
-}
 
-card deck::remove(card const& c)
-{
-	std::vector<card>::iterator it = std::find(pile.begin(), pile.end(), c);
-	if (it == pile.end()) {
-		throw std::invalid_argument("He or she does not have the card");
+	switch (mode) {
+	case shuffle_mode::fisher_yates:
+		for (unsigned int i = sz - 1; i > 0; --i) {
+			std::swap(pile[i], pile[detail::bounded_rand(generator, i + 1)]);
+		}
+		return;
+	case shuffle_mode::random_swap:
+		for (unsigned int i = 0; i < time; ++i) {
+			unsigned int a = detail::bounded_rand(generator, sz);
+			unsigned int b;
+			do {
+				b = detail::bounded_rand(generator, sz);
+			} while (a == b);
+			std::swap(pile[a], pile[b]);
+		}
+		return;
 	}
-	pile.erase(it);
-	return c;
-}
-
-std::ostream& deck::sort_by_number_ostream(std::ostream &os) const
-{
-	deck tmp = *this;
-	tmp.sort();
-	os << tmp;
-	return os;
 }
 
-std::ostream& deck::rank_only_ostream(std::ostream &os) const
+inline struct card poker::draw(unsigned int player_no)
 {
-	std::for_each(pile.cbegin(), pile.cend(), [&os](card const& crd) -> void {
-			os << crd.card_rank() << ' ';
-	});
-	return os;
-}
-
-
-std::ostream& deck::sort_by_suit_ostream(std::ostream &os) const
-{
-	for (int i = SPADE; i >= CLUB; --i) {
-		deck tmp = suit_subdeck(i);
-		tmp.set_print_mode(deck::print_mode::rank_only);
-		os << card::suit_image[i] << "  " << tmp << "\n";
+	PK_PROBE(draw);
+	if (player_no >= players) {
+		throw std::out_of_range("The player number is too large");
 	}
-	return os;
-}
-
-deck deck::suit_subdeck(int suit) const
-{
-	deck dktmp;
-	std::for_each(pile.cbegin(), pile.cend(), [=, &dktmp](card const& crd) -> void {
-			if (crd.suit == suit) {
-				dktmp.push_back(crd);
-			}
-	});
-	return dktmp;
+	player_card[player_no].push_back(pile.back());
+	pile.pop_back();
+	return player_card[player_no].back();
 }
 
-void deck::sort(sort_mode mode)
+template <std::size_t N>
+struct card poker::draw(fixed_hand<N>& hand)
 {
-	switch (mode)
-	{
-	case sort_mode::rank_first_descending:
-		std::sort(pile.begin(), pile.end(), [](card const &a, card const &b)->bool {
-			if (a.number != b.number) {
-				return a.number == 1 || (b.number != 1 && a.number > b.number);
-			}
-			return a.suit > b.suit;
-		});
-		return;
-	case sort_mode::suit_first_descending:
-		std::sort(pile.begin(), pile.end(), [](card const &a, card const &b)->bool {
-			if (a.suit == b.suit) {
-				return a.number == 1 || (b.number != 1 && a.number > b.number);
-			}
-			return a.suit > b.suit;
-		});
-		break;
-	default:
-		return;
+	PK_PROBE(draw);
+	if (pile.empty()) {
+		throw std::out_of_range("The pile is empty");
 	}
+	hand.push_back(pile.back());
+	pile.pop_back();
+	return hand.back();
 }
 
-void poker::sort_player_card()
-{
-	std::for_each(player_card.begin(), player_card.end(), [](deck& tmp) {
-		tmp.sort();
-	});
-}
-
-poker::poker(unsigned int deck, unsigned int player, bool joker) : players{player}
+template <std::size_t N>
+void poker::deal(unsigned int card_per_person, fixed_hand<N> *hands)
 {
-	if (player == 0) {
-		throw std::invalid_argument("Argument \'player\' cannot be zero");
+	PK_PROBE(deal);
+	if (static_cast<std::uint64_t>(card_per_person) * players > pile.size()) {
+		throw std::out_of_range("Not enough cards in the pile");
 	}
-
-	for (unsigned int k = 0; k < deck; ++k) {
-		for (unsigned char i = 0; i < 4; ++i) {
-			for (unsigned char j = 1; j <= 13; ++j) {
-				pile.push_back(card{i, j});
-			}
+	// Check every hand first, so that a full hand does not leave the deal half done
+	for (unsigned int p = 0; p < players; ++p) {
+		if (hands[p].size() + card_per_person > N) {
+			throw std::length_error("The hand is full");
 		}
-		if (joker) {
-			pile.push_back(card{1,14});
-			pile.push_back(card{1,14});
-		}
-	}
-
-	for (unsigned int i = 0; i < players; ++i) {
-		player_card.push_back(::pk::deck{});
 	}
-}
-
-void poker::shuffle(unsigned int time)
-{
-	unsigned int sz = pile.size();
-
-#if unix
-	std::random_device rd;
-	std::mt19937_64 generator(rd());
-#elif __WIN32 || __WINNT
-	std::mt19937_64 generator(::time(0));
-#else
-	std::random_device rd;
-	std::mt19937_64 generator(rd());
-#endif // unix
-	std::uniform_real_distribution<double> unif(0.0, static_cast<double>(sz));
-	for (unsigned int i = 0; i < time; ++i) {
-		unsigned int a = static_cast<unsigned int>(floor(unif(generator)));
-		unsigned int b;
-		do {
-			b = static_cast<unsigned int>(floor(unif(generator)));
-		} while (a == b);
-		std::swap(pile[a], pile[b]);
+	unsigned int player_no{0};
+	card_per_person *= players;
+	for (unsigned int card_count = 0; card_count < card_per_person; ++card_count) {
+		hands[player_no].push_back(pile.back());
+		pile.pop_back();
+		if (++player_no >= players) {
+			player_no = 0;
+		}
 	}
 }
 
-void poker::play(unsigned int player_no, card const& c)
+template <class URBG, typename>
+struct card poker::draw(unsigned int player_no, URBG& generator)
 {
+	PK_PROBE(draw);
 	if (player_no >= players) {
 		throw std::out_of_range("The player number is too large");
 	}
-	player_card[player_no].remove(c);
-}
-
-struct card poker::draw(unsigned int player_no)
-{
-	if (player_no >= players) {
-		throw std::out_of_range("The player number is too large");
+	if (pile.empty()) {
+		throw std::out_of_range("The pile is empty");
 	}
+	std::swap(pile[detail::bounded_rand(generator, static_cast<std::uint32_t>(pile.size()))], pile.back());
 	player_card[player_no].push_back(pile.back());
 	pile.pop_back();
 	return player_card[player_no].back();
 }
 
-void poker::deal(unsigned int card_per_person)
+template <class URBG, typename>
+void poker::deal(unsigned int card_per_person, URBG& generator)
 {
+	PK_PROBE(deal);
+	if (static_cast<std::uint64_t>(card_per_person) * players > pile.size()) {
+		throw std::out_of_range("Not enough cards in the pile");
+	}
 	unsigned int player_no{0};
 	card_per_person *= players;
 	for (unsigned int card_count = 0; card_count < card_per_person; ++card_count) {
+		std::swap(pile[detail::bounded_rand(generator, static_cast<std::uint32_t>(pile.size()))], pile.back());
 		player_card[player_no].push_back(pile.back());
 		pile.pop_back();
 		if (++player_no >= players) {
@@ -476,5 +1164,12 @@ void poker::deal(unsigned int card_per_person)
 	}
 }
 
+// The shuffles with the engines of rng.h and <random> are compiled once, in poker.cpp
+extern template void poker::shuffle<std::mt19937_64>(std::mt19937_64&, shuffle_mode, unsigned int);
+extern template void poker::shuffle<std::mt19937>(std::mt19937&, shuffle_mode, unsigned int);
+extern template void poker::shuffle<xoshiro256ss>(xoshiro256ss&, shuffle_mode, unsigned int);
+extern template void poker::shuffle<pcg64>(pcg64&, shuffle_mode, unsigned int);
+extern template void poker::shuffle<philox4x32>(philox4x32&, shuffle_mode, unsigned int);
+
 } // namespace poker
 #endif // POKER_H_
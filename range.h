@@ -0,0 +1,774 @@
+/* range.h Copyright 2019, 2023 TNPLR
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef RANGE_H_
+#define RANGE_H_
+
+#include "poker.h"
+#include "rng.h"
+#include "evaluator.h"
+#include "equity.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <list>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+/*
+ * Hand ranges and range-vs-range equity
+ * A range gives a weight in [0, 1] to each of the 1326 two-card combos. It is
+ * parsed from the usual notation, comma separated, with an optional weight:
+ *     AKs, QQ+, 76s, ATo+, KQ, 22-55, KJs-K9s, AhKh, JJ:0.5
+ * E.g.
+ *     pk::range_equity_request req;
+ *     req.ranges = {pk::hand_range::parse("QQ+, AKs"), pk::hand_range::parse("22+, A2s+")};
+ *     req.board = pk::card_set{flop};
+ *     pk::equity_result res = pk::range_equity(req);
+ *
+ * Combos holding a card of the board, of the dead cards or of another player are
+ * left out. Combo c_1 < c_2 of cards 0 - 51 (suit * 13 + rank, rank 0 - 12 being
+ * Two to Ace) has index c_2 * (c_2 - 1) / 2 + c_1.
+ */
+namespace pk {
+
+/** A weight for each two-card combo */
+class hand_range {
+public:
+	/** The number of two-card combos */
+	static constexpr std::size_t combos = 1326;
+
+	/** An empty range */
+	hand_range()
+	{
+		weight.fill(0.0f);
+	}
+
+	/** @return The combo index of two different cards (0 - 51 each) */
+	static constexpr std::size_t combo_index(unsigned int a, unsigned int b)
+	{
+		return a < b ? b * (b - 1) / 2 + a : a * (a - 1) / 2 + b;
+	}
+
+	/** @return The card (0 - 51) of suit and rank (0 - 12 are Two to Ace) */
+	static constexpr unsigned int card_number(unsigned int suit, unsigned int rank)
+	{
+		return suit * 13 + rank;
+	}
+
+	/** @return The two cards of a combo */
+	static card_set combo_cards(std::size_t index)
+	{
+		return card_set{table().mask[index]};
+	}
+
+	/** Parse a range, see the top of range.h
+	 * @param text The range
+	 * @return The range
+	 */
+	static hand_range parse(std::string_view text);
+
+	/** @return The weight of a combo */
+	inline float operator[](std::size_t index) const
+	{
+		return weight[index];
+	}
+
+	/** Set the weight of a combo
+	 * @param index The combo index
+	 * @param w The weight, in [0, 1]
+	 */
+	void set(std::size_t index, float w)
+	{
+		if (index >= combos) {
+			throw std::out_of_range("The combo index is too large");
+		}
+		if (!(w >= 0.0f && w <= 1.0f)) {
+			throw std::invalid_argument("A weight must be in [0, 1]");
+		}
+		weight[index] = w;
+	}
+
+	/** Set the weight of a combo
+	 * @param a The first card
+	 * @param b The second card, different from a
+	 * @param w The weight, in [0, 1]
+	 */
+	void set(card const& a, card const& b, float w = 1.0f)
+	{
+		unsigned int x = to_number(a), y = to_number(b);
+		if (x == y) {
+			throw std::invalid_argument("A combo needs two different cards");
+		}
+		set(combo_index(x, y), w);
+	}
+
+	/** @return The number of combos of a weight above zero */
+	std::size_t size() const
+	{
+		return static_cast<std::size_t>(std::count_if(weight.begin(), weight.end(), [](float w) { return w > 0.0f; }));
+	}
+
+	/** @return The weights of every combo */
+	inline std::array<float, combos> const& weights() const
+	{
+		return weight;
+	}
+
+	/** @return The same range without the combos holding any of the cards */
+	hand_range without(card_set cards) const
+	{
+		hand_range r = *this;
+		for (std::size_t i = 0; i < combos; ++i) {
+			if (table().mask[i] & cards.mask()) {
+				r.weight[i] = 0.0f;
+			}
+		}
+		return r;
+	}
+
+	bool operator==(hand_range const& rop) const
+	{
+		return weight == rop.weight;
+	}
+
+private:
+	struct combo_table {
+		std::uint64_t mask[combos]; /**< The card_set mask of each combo */
+	};
+
+	static combo_table const& table()
+	{
+		static const combo_table t = [] {
+			combo_table c{};
+			for (unsigned int b = 1; b < 52; ++b) {
+				for (unsigned int a = 0; a < b; ++a) {
+					c.mask[combo_index(a, b)] = 1ull << bit(a) | 1ull << bit(b);
+				}
+			}
+			return c;
+		}();
+		return t;
+	}
+
+	/** @return The card_set bit of card 0 - 51 */
+	static constexpr unsigned int bit(unsigned int number)
+	{
+		return number / 13 * 16 + number % 13;
+	}
+
+	static unsigned int to_number(card const& c)
+	{
+		if (c.number == 0 || c.number == 14) {
+			throw std::invalid_argument("A combo holds no joker nor empty card");
+		}
+		return card_number(c.suit, card_set::rank_index(c.number));
+	}
+
+	void add_pair(unsigned int rank, float w)
+	{
+		for (unsigned int s = 0; s < 4; ++s) {
+			for (unsigned int t = s + 1; t < 4; ++t) {
+				weight[combo_index(card_number(s, rank), card_number(t, rank))] = w;
+			}
+		}
+	}
+
+	/** Add the combos of two different ranks; kind is 's', 'o' or 0 for both */
+	void add_two(unsigned int high, unsigned int low, char kind, float w)
+	{
+		for (unsigned int s = 0; s < 4; ++s) {
+			for (unsigned int t = 0; t < 4; ++t) {
+				if ((kind == 's' && s != t) || (kind == 'o' && s == t)) {
+					continue;
+				}
+				weight[combo_index(card_number(s, high), card_number(t, low))] = w;
+			}
+		}
+	}
+
+	void parse_token(std::string_view token);
+
+	std::array<float, combos> weight;
+};
+
+namespace detail {
+/** @return The rank (0 - 12 are Two to Ace) of a rank character, or 13 */
+inline unsigned int rank_of_char(char c)
+{
+	static constexpr char ranks[] = "23456789TJQKA";
+	for (unsigned int r = 0; r < 13; ++r) {
+		if (c == ranks[r] || (r == 8 && c == 't') || (r >= 9 && c == ranks[r] + ('a' - 'A'))) {
+			return r;
+		}
+	}
+	return 13;
+}
+
+/** @return The suit of a suit character, or 4 */
+inline unsigned int suit_of_char(char c)
+{
+	switch (c) {
+	case 'c': return CLUB;
+	case 'd': return DIAMOND;
+	case 'h': return HEART;
+	case 's': return SPADE;
+	default: return 4;
+	}
+}
+
+inline std::string_view trim(std::string_view s)
+{
+	while (!s.empty() && (s.front() == ' ' || s.front() == '\t' || s.front() == '\n')) {
+		s.remove_prefix(1);
+	}
+	while (!s.empty() && (s.back() == ' ' || s.back() == '\t' || s.back() == '\n')) {
+		s.remove_suffix(1);
+	}
+	return s;
+}
+
+/** A hand class of the notation: two ranks and the kind ('s', 'o' or 0) */
+struct hand_class {
+	unsigned int high, low;
+	char kind;
+};
+
+inline hand_class parse_class(std::string_view s)
+{
+	if (s.size() < 2 || s.size() > 3) {
+		throw std::invalid_argument("Malformed hand in a range");
+	}
+	hand_class h{rank_of_char(s[0]), rank_of_char(s[1]), s.size() == 3 ? s[2] : '\0'};
+	if (h.high == 13 || h.low == 13 || (h.kind && h.kind != 's' && h.kind != 'o')) {
+		throw std::invalid_argument("Malformed hand in a range");
+	}
+	if (h.high == h.low && h.kind) {
+		throw std::invalid_argument("A pair is neither suited nor offsuit");
+	}
+	if (h.high < h.low) {
+		std::swap(h.high, h.low);
+	}
+	return h;
+}
+} // namespace detail
+
+inline void hand_range::parse_token(std::string_view token)
+{
+	float w = 1.0f;
+	const std::size_t colon = token.find(':');
+	if (colon != std::string_view::npos) {
+		const std::string number{detail::trim(token.substr(colon + 1))};
+		char *end = nullptr;
+		w = std::strtof(number.c_str(), &end);
+		if (number.empty() || *end != '\0' || !(w >= 0.0f && w <= 1.0f)) {
+			throw std::invalid_argument("A weight must be in [0, 1]");
+		}
+		token = detail::trim(token.substr(0, colon));
+	}
+
+	// A specific combo, e.g. AhKh
+	if (token.size() == 4 && detail::suit_of_char(token[1]) < 4 && detail::suit_of_char(token[3]) < 4) {
+		const unsigned int r1 = detail::rank_of_char(token[0]), r2 = detail::rank_of_char(token[2]);
+		if (r1 == 13 || r2 == 13) {
+			throw std::invalid_argument("Malformed combo in a range");
+		}
+		const unsigned int a = card_number(detail::suit_of_char(token[1]), r1);
+		const unsigned int b = card_number(detail::suit_of_char(token[3]), r2);
+		if (a == b) {
+			throw std::invalid_argument("A combo needs two different cards");
+		}
+		weight[combo_index(a, b)] = w;
+		return;
+	}
+
+	const std::size_t dash = token.find('-');
+	if (dash != std::string_view::npos) {
+		detail::hand_class from = detail::parse_class(detail::trim(token.substr(0, dash)));
+		detail::hand_class to = detail::parse_class(detail::trim(token.substr(dash + 1)));
+		if (from.high == from.low && to.high == to.low) {
+			for (unsigned int r = std::min(from.high, to.high); r <= std::max(from.high, to.high); ++r) {
+				add_pair(r, w);
+			}
+			return;
+		}
+		if (from.high != to.high || from.kind != to.kind || from.high == from.low || to.high == to.low) {
+			throw std::invalid_argument("A range of hands must keep the high card and the kind");
+		}
+		for (unsigned int r = std::min(from.low, to.low); r <= std::max(from.low, to.low); ++r) {
+			add_two(from.high, r, from.kind, w);
+		}
+		return;
+	}
+
+	const bool plus = !token.empty() && token.back() == '+';
+	if (plus) {
+		token.remove_suffix(1);
+	}
+	detail::hand_class h = detail::parse_class(token);
+	if (h.high == h.low) {
+		for (unsigned int r = h.high; r <= (plus ? 12u : h.high); ++r) {
+			add_pair(r, w);
+		}
+		return;
+	}
+	for (unsigned int r = h.low; r <= (plus ? h.high - 1 : h.low); ++r) {
+		add_two(h.high, r, h.kind, w);
+	}
+}
+
+inline hand_range hand_range::parse(std::string_view text)
+{
+	hand_range r;
+	while (!text.empty()) {
+		const std::size_t comma = text.find(',');
+		std::string_view token = detail::trim(text.substr(0, comma));
+		if (!token.empty()) {
+			r.parse_token(token);
+		} else if (comma != std::string_view::npos) {
+			throw std::invalid_argument("Empty hand in a range");
+		}
+		if (comma == std::string_view::npos) {
+			break;
+		}
+		text.remove_prefix(comma + 1);
+	}
+	return r;
+}
+
+/** The input of a range-vs-range equity calculation */
+struct range_equity_request {
+	std::vector<hand_range> ranges; /**< The range of each player */
+	card_set board; /**< Known board cards, at most 5 */
+	card_set dead; /**< Cards known to be out of the deck */
+	equity_mode mode = equity_mode::automatic; /**< The mode of calculation */
+	std::uint64_t enumerate_limit = 2000000; /**< The largest number of combo assignments times boards enumerated in automatic mode */
+	std::uint64_t trials = 1000000; /**< The number of sampled combo assignments and boards */
+	double confidence_z = 1.96; /**< The z-score of the confidence interval. Default to 95%. */
+	unsigned int threads = 0; /**< The number of workers. 0 is one per hardware thread. */
+	std::uint64_t seed = 0; /**< The seed of the samples */
+};
+
+namespace detail {
+/** The weighted counts of one player */
+struct range_tally {
+	double win = 0;
+	double tie = 0;
+	double share = 0;
+	double share_sq = 0;
+};
+
+/** A combo with a weight above zero */
+struct weighted_combo {
+	std::uint64_t mask;
+	double weight;
+};
+
+/** @return The combos of a range which fit with the known cards */
+inline std::vector<weighted_combo> live_combos(hand_range const& r, card_set known)
+{
+	std::vector<weighted_combo> live;
+	for (std::size_t i = 0; i < hand_range::combos; ++i) {
+		const std::uint64_t m = hand_range::combo_cards(i).mask();
+		if (r[i] > 0.0f && !(m & known.mask())) {
+			live.push_back(weighted_combo{m, r[i]});
+		}
+	}
+	return live;
+}
+
+/** @return Whether some assignment of one combo per player has no common card */
+inline bool any_assignment(std::vector<std::vector<weighted_combo>> const& live, std::size_t player, std::uint64_t used)
+{
+	if (player == live.size()) {
+		return true;
+	}
+	for (weighted_combo const& c : live[player]) {
+		if (!(c.mask & used) && any_assignment(live, player + 1, used | c.mask)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/** Decode a mixed-radix index into one combo per player, the digit of player 0 lowest
+ * @param hole The cards of each player
+ * @param used The known cards, to which the combos are added
+ * @param weight The product of the weights of the combos
+ * @return Whether the combos have no common card
+ */
+inline bool assignment(std::vector<std::vector<weighted_combo>> const& live, std::uint64_t index,
+	std::vector<card_set>& hole, std::uint64_t& used, double& weight)
+{
+	weight = 1.0;
+	for (std::size_t p = 0; p < live.size(); ++p) {
+		weighted_combo const& c = live[p][index % live[p].size()];
+		index /= live[p].size();
+		if (c.mask & used) {
+			return false;
+		}
+		used |= c.mask;
+		hole[p] = card_set{c.mask};
+		weight *= c.weight;
+	}
+	return true;
+}
+} // namespace detail
+
+/** Calculate the equity of every range over the rest of the board
+ * Combo assignments are weighted by the product of the weights of their combos.
+ * Trials are sampled in batches like equity(), so the result does not depend on the number of threads.
+ * @param req The request
+ * @return The weighted win/tie/loss fractions and the equity of each range; trials counts the boards evaluated
+ */
+inline equity_result range_equity(range_equity_request const& req)
+{
+	const std::size_t players = req.ranges.size();
+	if (players == 0) {
+		throw std::invalid_argument("At least one player is needed");
+	}
+	if (req.board.size() > 5) {
+		throw std::invalid_argument("The board has more than 5 cards");
+	}
+	if ((req.board & req.dead) != card_set{} || ((req.board | req.dead) & card_set{card_set::joker_mask}) != card_set{}) {
+		throw std::invalid_argument("The board and the dead cards overlap or hold a joker");
+	}
+	const card_set known = req.board | req.dead;
+	const card_set rest = card_set::full() - known;
+	const unsigned int missing = 5 - req.board.size();
+	if (rest.size() < missing + 2 * players) {
+		throw std::invalid_argument("Not enough cards left to complete the board");
+	}
+
+	std::vector<std::vector<detail::weighted_combo>> live(players);
+	std::uint64_t product = 1;
+	for (std::size_t p = 0; p < players; ++p) {
+		live[p] = detail::live_combos(req.ranges[p], known);
+		if (live[p].empty()) {
+			throw std::invalid_argument("A range has no combo left");
+		}
+		product = std::min<std::uint64_t>(product * live[p].size(), 0x100000000ull);
+	}
+	// One work item per mixed-radix index of an assignment, including those with a common card
+	if (req.mode == equity_mode::enumerate && product > 0xFFFFFFFFull) {
+		throw std::invalid_argument("Too many combo assignments to enumerate");
+	}
+	const std::uint64_t boards = detail::binomial(rest.size() - 2 * static_cast<unsigned int>(players), missing);
+
+	// Enumerate when every assignment times every board is few enough. The assignments are
+	// counted, not stored, and each worker decodes its own from the index of the item.
+	bool exact = req.mode == equity_mode::enumerate
+		|| (req.mode == equity_mode::automatic && product * boards <= req.enumerate_limit);
+	if (exact && !detail::any_assignment(live, 0, 0)) {
+		throw std::invalid_argument("Every combo assignment shares a card");
+	}
+
+	const std::uint64_t items = exact ? product : (req.trials + detail::equity_batch - 1) / detail::equity_batch;
+	if (items > 0xFFFFFFFFull) {
+		throw std::invalid_argument("Too many trials");
+	}
+	const unsigned int workers = detail::worker_count(req.threads, items);
+	detail::work_ranges ranges(workers, static_cast<std::uint32_t>(items));
+
+	// The cumulative weights of each range, to sample a combo by binary search
+	std::vector<std::vector<double>> cdf(players);
+	for (std::size_t p = 0; p < players; ++p) {
+		double sum = 0;
+		for (detail::weighted_combo const& c : live[p]) {
+			cdf[p].push_back(sum += c.weight);
+		}
+	}
+
+	std::vector<std::vector<detail::range_tally>> tally(workers, std::vector<detail::range_tally>(players));
+	std::vector<double> mass(workers, 0);
+	std::vector<std::uint64_t> evaluated(workers, 0);
+	std::atomic<std::uint32_t> conflicts{0};
+
+	auto worker = [&](unsigned int w) {
+		std::uint8_t deck[52];
+		std::vector<card_set> hole(players);
+		std::vector<hand_strength> strength(players);
+		std::vector<detail::equity_tally> one(players);
+		std::vector<detail::range_tally>& t = tally[w];
+		std::uint32_t item;
+		while (ranges.next(w, item)) {
+			if (exact) {
+				std::uint64_t used = known.mask();
+				double wt;
+				if (!detail::assignment(live, item, hole, used, wt)) {
+					continue;
+				}
+				unsigned int deck_size = 0;
+				for (std::uint64_t m = card_set::full_deck & ~used; m; m &= m - 1) {
+					deck[deck_size++] = static_cast<std::uint8_t>(detail::ctz64(m));
+				}
+				std::fill(one.begin(), one.end(), detail::equity_tally{});
+				detail::colex_subset subset(deck_size, missing, 0);
+				for (std::uint64_t i = 0; i < boards; ++i, subset.next()) {
+					std::uint64_t board = req.board.mask();
+					for (unsigned int k = 0; k < missing; ++k) {
+						board |= 1ull << deck[subset[k]];
+					}
+					detail::score_board(hole, card_set{board}, one.data(), strength.data());
+				}
+				for (std::size_t p = 0; p < players; ++p) {
+					t[p].win += wt * one[p].win;
+					t[p].tie += wt * one[p].tie;
+					t[p].share += wt * one[p].share;
+				}
+				mass[w] += wt * boards;
+				evaluated[w] += boards;
+				continue;
+			}
+
+			philox4x32 generator(req.seed, item);
+			const std::uint64_t first = static_cast<std::uint64_t>(item) * detail::equity_batch;
+			const std::uint64_t count = std::min<std::uint64_t>(detail::equity_batch, req.trials - first);
+			unsigned int rest_size = 0;
+			for (std::uint64_t m = rest.mask(); m; m &= m - 1) {
+				deck[rest_size++] = static_cast<std::uint8_t>(detail::ctz64(m));
+			}
+			for (std::uint64_t i = 0; i < count; ++i) {
+				// Sample every combo by weight, and start again on a common card: the accepted
+				// assignments are distributed as the product of the weights
+				std::uint64_t used;
+				for (unsigned int attempt = 0;; ++attempt) {
+					if (attempt == 10000) {
+						conflicts.store(1, std::memory_order_relaxed);
+						return;
+					}
+					used = known.mask();
+					std::size_t p = 0;
+					for (; p < players; ++p) {
+						const std::uint64_t bits = static_cast<std::uint64_t>(generator()) << 32 | generator();
+						const double u = (bits >> 11) * 0x1.0p-53 * cdf[p].back();
+						const std::size_t k = std::min<std::size_t>(
+							std::upper_bound(cdf[p].begin(), cdf[p].end(), u) - cdf[p].begin(), cdf[p].size() - 1);
+						const std::uint64_t m = live[p][k].mask;
+						if (m & used) {
+							break;
+						}
+						used |= m;
+						hole[p] = card_set{m};
+					}
+					if (p == players) {
+						break;
+					}
+				}
+				std::uint64_t board = req.board.mask();
+				for (unsigned int k = 0; k < missing; ++k) {
+					std::uint64_t bit;
+					do {
+						bit = 1ull << deck[detail::bounded_rand(generator, rest_size)];
+					} while (bit & used);
+					used |= bit;
+					board |= bit;
+				}
+				std::fill(one.begin(), one.end(), detail::equity_tally{});
+				detail::score_board(hole, card_set{board}, one.data(), strength.data());
+				for (std::size_t p = 0; p < players; ++p) {
+					t[p].win += one[p].win;
+					t[p].tie += one[p].tie;
+					t[p].share += one[p].share;
+					t[p].share_sq += one[p].share_sq;
+				}
+			}
+			mass[w] += count;
+			evaluated[w] += count;
+		}
+	};
+	detail::run_workers(workers, worker);
+	if (conflicts.load()) {
+		throw std::invalid_argument("The ranges almost never fit together");
+	}
+
+	std::vector<detail::range_tally> sum(players);
+	double total = 0;
+	std::uint64_t trials = 0;
+	for (unsigned int w = 0; w < workers; ++w) {
+		total += mass[w];
+		trials += evaluated[w];
+		for (std::size_t p = 0; p < players; ++p) {
+			sum[p].win += tally[w][p].win;
+			sum[p].tie += tally[w][p].tie;
+			sum[p].share += tally[w][p].share;
+			sum[p].share_sq += tally[w][p].share_sq;
+		}
+	}
+	equity_result res;
+	res.trials = trials;
+	res.exact = exact;
+	for (detail::range_tally const& s : sum) {
+		player_equity pe{};
+		pe.win = s.win / total;
+		pe.tie = s.tie / total;
+		pe.loss = 1.0 - pe.win - pe.tie;
+		pe.equity = s.share / total;
+		pe.std_error = exact ? 0 : detail::std_error(s.share, s.share_sq, total);
+		pe.ci_low = std::max(0.0, pe.equity - req.confidence_z * pe.std_error);
+		pe.ci_high = std::min(1.0, pe.equity + req.confidence_z * pe.std_error);
+		res.players.push_back(pe);
+	}
+	return res;
+}
+
+/**
+ * A least-recently-used cache of range_equity() results, safe to share between threads
+ * The key is canonical: combos which cannot be dealt with the board and the dead
+ * cards do not count, so ranges differing only by those share an entry.
+ */
+class range_equity_cache {
+public:
+	/** @param cap The number of results kept. Default to 4096. */
+	explicit range_equity_cache(std::size_t cap = 4096) : capacity{cap ? cap : 1}
+	{
+	}
+
+	/** @return The result of a request, calculated on a miss */
+	equity_result get(range_equity_request const& req)
+	{
+		entry key = make_key(req);
+		{
+			std::lock_guard<std::mutex> guard{lock};
+			if (equity_result const *hit = find(key)) {
+				++hit_count;
+				return *hit;
+			}
+			++miss_count;
+		}
+		// Calculated unlocked: two threads missing the same key both calculate it
+		equity_result res = range_equity(req);
+		std::lock_guard<std::mutex> guard{lock};
+		if (find(key)) {
+			return res;
+		}
+		key.result = res;
+		order.push_front(std::move(key));
+		index.emplace(order.front().hash, order.begin());
+		if (order.size() > capacity) {
+			auto last = std::prev(order.end());
+			auto range = index.equal_range(last->hash);
+			for (auto it = range.first; it != range.second; ++it) {
+				if (it->second == last) {
+					index.erase(it);
+					break;
+				}
+			}
+			order.pop_back();
+		}
+		return res;
+	}
+
+	/** @return The number of results kept */
+	std::size_t size() const
+	{
+		std::lock_guard<std::mutex> guard{lock};
+		return order.size();
+	}
+
+	/** @return The number of hits */
+	std::uint64_t hits() const
+	{
+		std::lock_guard<std::mutex> guard{lock};
+		return hit_count;
+	}
+
+	/** @return The number of misses */
+	std::uint64_t misses() const
+	{
+		std::lock_guard<std::mutex> guard{lock};
+		return miss_count;
+	}
+
+private:
+	struct entry {
+		std::uint64_t hash;
+		std::vector<float> weights; /**< The canonical weights of every range, one after another */
+		std::uint64_t board, dead;
+		equity_mode mode;
+		std::uint64_t limit, trials, seed;
+		double z;
+		equity_result result;
+
+		bool same_key(entry const& rop) const
+		{
+			return hash == rop.hash && board == rop.board && dead == rop.dead && mode == rop.mode
+				&& limit == rop.limit && trials == rop.trials && seed == rop.seed && z == rop.z
+				&& weights == rop.weights;
+		}
+	};
+
+	static entry make_key(range_equity_request const& req)
+	{
+		entry e{};
+		const card_set known = req.board | req.dead;
+		e.weights.reserve(req.ranges.size() * hand_range::combos);
+		for (hand_range const& r : req.ranges) {
+			hand_range canonical = r.without(known);
+			e.weights.insert(e.weights.end(), canonical.weights().begin(), canonical.weights().end());
+		}
+		e.board = req.board.mask();
+		e.dead = req.dead.mask();
+		e.mode = req.mode;
+		e.limit = req.enumerate_limit;
+		e.trials = req.trials;
+		e.seed = req.seed;
+		e.z = req.confidence_z;
+
+		std::uint64_t h = e.board * 0x9E3779B97F4A7C15ull ^ e.dead;
+		h = h * 0x100000001B3ull ^ static_cast<std::uint64_t>(e.mode) ^ e.limit << 8 ^ e.trials << 16 ^ e.seed << 24;
+		for (std::size_t i = 0; i < e.weights.size(); ++i) {
+			if (e.weights[i] > 0.0f) {
+				std::uint32_t bits;
+				std::memcpy(&bits, &e.weights[i], sizeof bits);
+				std::uint64_t x = i << 32 | bits;
+				h ^= splitmix64(x);
+				h *= 0x100000001B3ull;
+			}
+		}
+		e.hash = h;
+		return e;
+	}
+
+	equity_result const *find(entry const& key)
+	{
+		auto range = index.equal_range(key.hash);
+		for (auto it = range.first; it != range.second; ++it) {
+			if (it->second->same_key(key)) {
+				order.splice(order.begin(), order, it->second);
+				return &it->second->result;
+			}
+		}
+		return nullptr;
+	}
+
+	std::size_t capacity;
+	mutable std::mutex lock;
+	std::list<entry> order; /**< The most recently used first */
+	std::unordered_multimap<std::uint64_t, std::list<entry>::iterator> index;
+	std::uint64_t hit_count = 0;
+	std::uint64_t miss_count = 0;
+};
+
+} // namespace pk
+#endif // RANGE_H_
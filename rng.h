@@ -0,0 +1,350 @@
+/* rng.h Copyright 2019, 2023 TNPLR
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef RNG_H_
+#define RNG_H_
+
+#if __WIN32 || __WINNT
+#include <ctime>
+#endif //__WIN32 || __WINNT
+
+#include <cstdint>
+#include <random>
+#include <limits>
+
+/*
+ * Random engines for poker::shuffle
+ * Every engine here is a uniform random bit generator, so it can be passed
+ * to poker::shuffle(generator, mode) or to any <random> distribution.
+ * E.g.
+ *     pk::xoshiro256ss generator(pk::random_seed());
+ *     game.shuffle(generator);
+ */
+namespace pk {
+
+/** @return A 64-bit seed from the system entropy source */
+inline std::uint64_t random_seed()
+{
+#if __WIN32 || __WINNT
+	return static_cast<std::uint64_t>(::time(0));
+#else
+	std::random_device rd;
+	return (static_cast<std::uint64_t>(rd()) << 32) ^ rd();
+#endif // __WIN32 || __WINNT
+}
+
+/** SplitMix64, used to expand a 64-bit seed into a larger state
+ * @param x The state, advanced by the call
+ * @return The next output
+ */
+inline std::uint64_t splitmix64(std::uint64_t& x)
+{
+	std::uint64_t z = (x += 0x9e3779b97f4a7c15ull);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+	return z ^ (z >> 31);
+}
+
+/**
+ * xoshiro256** 1.0 by Blackman and Vigna
+ * 32 bytes of state, period 2^256 - 1.
+ */
+class xoshiro256ss {
+public:
+	using result_type = std::uint64_t;
+
+	/** A constructor of the engine
+	 * @param seed The seed, expanded with SplitMix64. Default to 0.
+	 */
+	explicit xoshiro256ss(std::uint64_t seed = 0)
+	{
+		this->seed(seed);
+	}
+
+	/** Reseed the engine
+	 * @param seed The seed, expanded with SplitMix64
+	 */
+	void seed(std::uint64_t seed)
+	{
+		for (auto& word : s) {
+			word = splitmix64(seed);
+		}
+	}
+
+	static constexpr result_type min() { return 0; }
+	static constexpr result_type max() { return std::numeric_limits<result_type>::max(); }
+
+	/** @return The next 64 random bits */
+	inline result_type operator()()
+	{
+		const std::uint64_t result = rotl(s[1] * 5, 7) * 9;
+		const std::uint64_t t = s[1] << 17;
+		s[2] ^= s[0];
+		s[3] ^= s[1];
+		s[1] ^= s[2];
+		s[0] ^= s[3];
+		s[2] ^= t;
+		s[3] = rotl(s[3], 45);
+		return result;
+	}
+
+	/** Advance the engine by 2^128 steps
+	 * Calling it k times on copies of one engine gives k non-overlapping streams.
+	 */
+	void jump()
+	{
+		static constexpr std::uint64_t table[4]{0x180ec6d33cfd0abaull, 0xd5a61266f0c9392cull, 0xa9582618e03fc9aaull, 0x39abdc4529b1661cull};
+		std::uint64_t t[4]{0, 0, 0, 0};
+		for (std::uint64_t word : table) {
+			for (int b = 0; b < 64; ++b) {
+				if (word & (1ull << b)) {
+					t[0] ^= s[0];
+					t[1] ^= s[1];
+					t[2] ^= s[2];
+					t[3] ^= s[3];
+				}
+				(*this)();
+			}
+		}
+		for (int i = 0; i < 4; ++i) {
+			s[i] = t[i];
+		}
+	}
+
+	/** Skip n outputs */
+	void discard(unsigned long long n)
+	{
+		for (; n > 0; --n) {
+			(*this)();
+		}
+	}
+
+	bool operator==(xoshiro256ss const& rop) const
+	{
+		return s[0] == rop.s[0] && s[1] == rop.s[1] && s[2] == rop.s[2] && s[3] == rop.s[3];
+	}
+
+private:
+	static inline std::uint64_t rotl(std::uint64_t x, int k)
+	{
+		return (x << k) | (x >> (64 - k));
+	}
+
+	std::uint64_t s[4]; /**< Internal state */
+};
+
+/**
+ * PCG64 (pcg_setseq_128_xsl_rr_64) by O'Neill
+ * 128-bit LCG state with a selectable stream, 64-bit output.
+ */
+class pcg64 {
+public:
+	using result_type = std::uint64_t;
+
+	/** A constructor of the engine
+	 * @param seed The initial state. Default to 0.
+	 * @param stream The stream (sequence) selector. Distinct streams never overlap. Default to 0.
+	 */
+	explicit pcg64(std::uint64_t seed = 0, std::uint64_t stream = 0)
+	{
+		this->seed(seed, stream);
+	}
+
+	/** Reseed the engine
+	 * @param seed The initial state
+	 * @param stream The stream (sequence) selector
+	 */
+	void seed(std::uint64_t seed, std::uint64_t stream = 0)
+	{
+		hi = lo = 0;
+		inc_hi = stream >> 63;
+		inc_lo = (stream << 1) | 1u;
+		step();
+		add(0, seed);
+		step();
+	}
+
+	static constexpr result_type min() { return 0; }
+	static constexpr result_type max() { return std::numeric_limits<result_type>::max(); }
+
+	/** @return The next 64 random bits */
+	inline result_type operator()()
+	{
+		step();
+		const std::uint64_t x = hi ^ lo;
+		const unsigned int rot = static_cast<unsigned int>(hi >> 58);
+		return (x >> rot) | (x << ((64 - rot) & 63));
+	}
+
+	/** Skip n outputs */
+	void discard(unsigned long long n)
+	{
+		for (; n > 0; --n) {
+			step();
+		}
+	}
+
+	bool operator==(pcg64 const& rop) const
+	{
+		return hi == rop.hi && lo == rop.lo && inc_hi == rop.inc_hi && inc_lo == rop.inc_lo;
+	}
+
+private:
+	static constexpr std::uint64_t mul_hi = 2549297995355413924ull;
+	static constexpr std::uint64_t mul_lo = 4865540595714422341ull;
+
+	/** 64 x 64 -> 128 bit multiplication */
+	static inline void mul64(std::uint64_t a, std::uint64_t b, std::uint64_t& rhi, std::uint64_t& rlo)
+	{
+#ifdef __SIZEOF_INT128__
+		unsigned __int128 p = static_cast<unsigned __int128>(a) * b;
+		rhi = static_cast<std::uint64_t>(p >> 64);
+		rlo = static_cast<std::uint64_t>(p);
+#else
+		std::uint64_t a_lo = a & 0xffffffffu, a_hi = a >> 32;
+		std::uint64_t b_lo = b & 0xffffffffu, b_hi = b >> 32;
+		std::uint64_t p0 = a_lo * b_lo, p1 = a_lo * b_hi, p2 = a_hi * b_lo, p3 = a_hi * b_hi;
+		std::uint64_t mid = (p0 >> 32) + (p1 & 0xffffffffu) + (p2 & 0xffffffffu);
+		rlo = (mid << 32) | (p0 & 0xffffffffu);
+		rhi = p3 + (p1 >> 32) + (p2 >> 32) + (mid >> 32);
+#endif // __SIZEOF_INT128__
+	}
+
+	inline void add(std::uint64_t a_hi, std::uint64_t a_lo)
+	{
+		lo += a_lo;
+		hi += a_hi + (lo < a_lo);
+	}
+
+	/** state = state * multiplier + increment (mod 2^128) */
+	inline void step()
+	{
+		std::uint64_t p_hi, p_lo;
+		mul64(lo, mul_lo, p_hi, p_lo);
+		p_hi += lo * mul_hi + hi * mul_lo;
+		hi = p_hi;
+		lo = p_lo;
+		add(inc_hi, inc_lo);
+	}
+
+	std::uint64_t hi, lo; /**< The 128-bit state */
+	std::uint64_t inc_hi, inc_lo; /**< The 128-bit increment (odd) */
+};
+
+/**
+ * Philox4x32-10 by Salmon et al., a counter-based engine
+ * The output is a pure function of (key, counter): the key is the seed, and the
+ * counter holds a 64-bit stream id (e.g. a hand id) and a 64-bit block number.
+ * So any hand can be reproduced from (seed, hand_id) without keeping any state.
+ * E.g.
+ *     pk::philox4x32 generator(seed, hand_id);
+ *     game.shuffle(generator);
+ */
+class philox4x32 {
+public:
+	using result_type = std::uint32_t;
+
+	/** A constructor of the engine
+	 * @param seed The key. Default to 0.
+	 * @param stream The stream id. Default to 0.
+	 */
+	explicit philox4x32(std::uint64_t seed = 0, std::uint64_t stream = 0)
+	{
+		this->seed(seed, stream);
+	}
+
+	/** Reseed the engine and rewind to the first block
+	 * @param seed The key
+	 * @param stream The stream id
+	 */
+	void seed(std::uint64_t seed, std::uint64_t stream = 0)
+	{
+		key[0] = static_cast<std::uint32_t>(seed);
+		key[1] = static_cast<std::uint32_t>(seed >> 32);
+		this->stream = stream;
+		block_no = 0;
+		index = 4;
+	}
+
+	static constexpr result_type min() { return 0; }
+	static constexpr result_type max() { return std::numeric_limits<result_type>::max(); }
+
+	/** @return The next 32 random bits */
+	inline result_type operator()()
+	{
+		if (index == 4) {
+			block(key[0], key[1], block_no++, stream, buffer);
+			index = 0;
+		}
+		return buffer[index++];
+	}
+
+	/** Skip n outputs in O(1) */
+	void discard(unsigned long long n)
+	{
+		unsigned long long pos = block_no * 4 - (4 - index) + n;
+		block_no = pos / 4;
+		index = 4;
+		for (unsigned int i = pos % 4; i > 0; --i) {
+			(*this)();
+		}
+	}
+
+	/** Compute one block of Philox4x32-10
+	 * @param k0 The low word of the key
+	 * @param k1 The high word of the key
+	 * @param block_no The block number (low half of the counter)
+	 * @param stream The stream id (high half of the counter)
+	 * @param out The 4 output words
+	 */
+	static inline void block(std::uint32_t k0, std::uint32_t k1, std::uint64_t block_no, std::uint64_t stream, std::uint32_t out[4])
+	{
+		std::uint32_t c0 = static_cast<std::uint32_t>(block_no);
+		std::uint32_t c1 = static_cast<std::uint32_t>(block_no >> 32);
+		std::uint32_t c2 = static_cast<std::uint32_t>(stream);
+		std::uint32_t c3 = static_cast<std::uint32_t>(stream >> 32);
+		for (int round = 0; round < 10; ++round) {
+			const std::uint64_t p0 = static_cast<std::uint64_t>(0xD2511F53u) * c0;
+			const std::uint64_t p1 = static_cast<std::uint64_t>(0xCD9E8D57u) * c2;
+			const std::uint32_t n0 = static_cast<std::uint32_t>(p1 >> 32) ^ c1 ^ k0;
+			const std::uint32_t n2 = static_cast<std::uint32_t>(p0 >> 32) ^ c3 ^ k1;
+			c1 = static_cast<std::uint32_t>(p1);
+			c3 = static_cast<std::uint32_t>(p0);
+			c0 = n0;
+			c2 = n2;
+			k0 += 0x9E3779B9u;
+			k1 += 0xBB67AE85u;
+		}
+		out[0] = c0;
+		out[1] = c1;
+		out[2] = c2;
+		out[3] = c3;
+	}
+
+	bool operator==(philox4x32 const& rop) const
+	{
+		return key[0] == rop.key[0] && key[1] == rop.key[1] && stream == rop.stream
+			&& block_no * 4 - (4 - index) == rop.block_no * 4 - (4 - rop.index);
+	}
+
+private:
+	std::uint32_t key[2]; /**< The seed */
+	std::uint64_t stream; /**< The high half of the counter */
+	std::uint64_t block_no; /**< The low half of the counter (next block to compute) */
+	std::uint32_t buffer[4]; /**< The current block */
+	unsigned int index; /**< The next word of buffer to return. 4 means empty. */
+};
+
+} // namespace pk
+#endif // RNG_H_
@@ -21,7 +21,7 @@ int main()
 	std::cout << "Player 2 " << game[2] << '\n';
 	std::cout << "Player 3 " << game[3] << '\n';
 	std::cout << "Player 2, card 3: " << game[2][3] << " Number:" << game[2][3].number << " suit:" << game[2][3].suit << '\n';
-	game.play(2, 3);
+	game.play(2, game[2][3]);
 	std::cout << "Play 2, 3\nPlayer 2 " << game[2] << '\n';
 
 	return 0;
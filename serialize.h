@@ -0,0 +1,345 @@
+/* serialize.h Copyright 2019, 2023 TNPLR
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef SERIALIZE_H_
+#define SERIALIZE_H_
+
+#include "poker.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string_view>
+
+/*
+ * Binary wire format of cards, decks and games
+ *
+ *     card      1 byte: suit << 4 | number
+ *     card_set  8 bytes: the mask, little-endian
+ *     deck      varint n, then n cards
+ *     poker     byte version (1), varint players, varint decks, byte joker,
+ *               deck pile, then one deck per player
+ *
+ * A varint is an unsigned LEB128 number. Every encoder writes into a buffer of
+ * the caller and returns the number of bytes written; encoded_size() gives the
+ * size of buffer needed. Every decoder reads from a buffer of the caller and
+ * returns the number of bytes consumed.
+ * E.g.
+ *     std::vector<unsigned char> buf(pk::encoded_size(game));
+ *     pk::encode(game, buf.data(), buf.size());
+ *     pk::decode(buf.data(), buf.size(), other_game);
+ *
+ * The text parsers read the format of operator<<, e.g. "♠  A  ♥ 10  JOKER".
+ */
+namespace pk {
+
+/** The version byte of an encoded poker game */
+constexpr unsigned char poker_format_version = 1;
+
+/** The most decks of a decoded game, so that a corrupt count cannot make reset() exhaust memory */
+constexpr std::uint64_t poker_max_decks = 0xFFFF;
+
+namespace detail {
+/** @return The number of bytes of a varint */
+inline std::size_t varint_size(std::uint64_t v)
+{
+	std::size_t n = 1;
+	while (v >= 0x80) {
+		v >>= 7;
+		++n;
+	}
+	return n;
+}
+
+/** Write a varint, the buffer being known to be large enough */
+inline unsigned char *put_varint(unsigned char *p, std::uint64_t v)
+{
+	while (v >= 0x80) {
+		*p++ = static_cast<unsigned char>(v | 0x80);
+		v >>= 7;
+	}
+	*p++ = static_cast<unsigned char>(v);
+	return p;
+}
+
+/** Read a varint
+ * @param p The position, advanced past the varint
+ * @param end The end of the buffer
+ */
+inline std::uint64_t get_varint(unsigned char const *&p, unsigned char const *end)
+{
+	std::uint64_t v = 0;
+	for (unsigned int shift = 0; shift < 64; shift += 7) {
+		if (p == end) {
+			throw std::invalid_argument("Truncated varint");
+		}
+		unsigned char byte = *p++;
+		v |= static_cast<std::uint64_t>(byte & 0x7F) << shift;
+		if (!(byte & 0x80)) {
+			return v;
+		}
+	}
+	throw std::invalid_argument("Malformed varint");
+}
+
+inline void check_space(std::size_t need, std::size_t cap)
+{
+	if (need > cap) {
+		throw std::length_error("The buffer is too small");
+	}
+}
+
+/** @return A card from its byte */
+inline card card_from_byte(unsigned char byte)
+{
+	if ((byte & 0x0F) > 14 || (byte >> 4) > 3) {
+		throw std::invalid_argument("Malformed card");
+	}
+	return card{static_cast<unsigned short>(byte >> 4), static_cast<unsigned short>(byte & 0x0F)};
+}
+
+/** Decode a deck, appending to out */
+inline unsigned char const *get_deck(unsigned char const *p, unsigned char const *end, deck& out)
+{
+	std::uint64_t n = get_varint(p, end);
+	if (n > static_cast<std::uint64_t>(end - p)) {
+		throw std::invalid_argument("Truncated deck");
+	}
+	out.reserve(out.size() + n);
+	for (std::uint64_t i = 0; i < n; ++i) {
+		out.push_back(card_from_byte(*p++));
+	}
+	return p;
+}
+} // namespace detail
+
+/** @return The byte of a card */
+inline unsigned char to_byte(card const& c)
+{
+	return static_cast<unsigned char>(c.suit << 4 | c.number);
+}
+
+/** @return The number of bytes of an encoded deck */
+inline std::size_t encoded_size(deck const& dk)
+{
+	return detail::varint_size(dk.size()) + dk.size();
+}
+
+/** @return The number of bytes of an encoded card_set */
+inline std::size_t encoded_size(card_set)
+{
+	return 8;
+}
+
+/** @return The number of bytes of an encoded game */
+inline std::size_t encoded_size(poker const& pk)
+{
+	std::size_t n = 2 + detail::varint_size(pk.player_count()) + detail::varint_size(pk.deck_count());
+	n += encoded_size(pk.card_pile());
+	for (unsigned int i = 0; i < pk.player_count(); ++i) {
+		n += encoded_size(pk[i]);
+	}
+	return n;
+}
+
+/** Encode a deck
+ * @param dk The deck
+ * @param buf The buffer
+ * @param cap The size of the buffer
+ * @return The number of bytes written
+ */
+inline std::size_t encode(deck const& dk, unsigned char *buf, std::size_t cap)
+{
+	detail::check_space(encoded_size(dk), cap);
+	unsigned char *p = detail::put_varint(buf, dk.size());
+	for (std::size_t i = 0; i < dk.size(); ++i) {
+		*p++ = to_byte(dk[i]);
+	}
+	return static_cast<std::size_t>(p - buf);
+}
+
+/** Encode a card_set
+ * @param cs The cards
+ * @param buf The buffer
+ * @param cap The size of the buffer
+ * @return The number of bytes written
+ */
+inline std::size_t encode(card_set cs, unsigned char *buf, std::size_t cap)
+{
+	detail::check_space(8, cap);
+	std::uint64_t m = cs.mask();
+	for (int i = 0; i < 8; ++i) {
+		buf[i] = static_cast<unsigned char>(m >> (8 * i));
+	}
+	return 8;
+}
+
+/** Encode a game: the layout, the pile and every hand
+ * @param pk The game
+ * @param buf The buffer
+ * @param cap The size of the buffer
+ * @return The number of bytes written
+ */
+inline std::size_t encode(poker const& pk, unsigned char *buf, std::size_t cap)
+{
+	detail::check_space(encoded_size(pk), cap);
+	unsigned char *p = buf;
+	*p++ = poker_format_version;
+	p = detail::put_varint(p, pk.player_count());
+	p = detail::put_varint(p, pk.deck_count());
+	*p++ = pk.has_joker();
+	unsigned char *end = buf + cap;
+	p += encode(pk.card_pile(), p, static_cast<std::size_t>(end - p));
+	for (unsigned int i = 0; i < pk.player_count(); ++i) {
+		p += encode(pk[i], p, static_cast<std::size_t>(end - p));
+	}
+	return static_cast<std::size_t>(p - buf);
+}
+
+/** Decode a deck, replacing the cards of out
+ * @param buf The buffer
+ * @param len The size of the buffer
+ * @param out The deck
+ * @return The number of bytes consumed
+ */
+inline std::size_t decode(unsigned char const *buf, std::size_t len, deck& out)
+{
+	out.clear();
+	return static_cast<std::size_t>(detail::get_deck(buf, buf + len, out) - buf);
+}
+
+/** Decode a card_set
+ * @param buf The buffer
+ * @param len The size of the buffer
+ * @param out The cards
+ * @return The number of bytes consumed
+ */
+inline std::size_t decode(unsigned char const *buf, std::size_t len, card_set& out)
+{
+	if (len < 8) {
+		throw std::invalid_argument("Truncated card_set");
+	}
+	std::uint64_t m = 0;
+	for (int i = 0; i < 8; ++i) {
+		m |= static_cast<std::uint64_t>(buf[i]) << (8 * i);
+	}
+	if (m & ~(card_set::full_deck | card_set::joker_mask)) {
+		throw std::invalid_argument("Malformed card_set");
+	}
+	out = card_set{m};
+	return 8;
+}
+
+/** Decode a game, replacing the layout, the pile and every hand of pk
+ * The game is decoded aside on the memory resource of pk and moved into it at the end,
+ * so pk is left as it was if the buffer is truncated or malformed.
+ * @param buf The buffer
+ * @param len The size of the buffer
+ * @param pk The game
+ * @return The number of bytes consumed
+ */
+inline std::size_t decode(unsigned char const *buf, std::size_t len, poker& pk)
+{
+	unsigned char const *p = buf, *end = buf + len;
+	if (p == end || *p++ != poker_format_version) {
+		throw std::invalid_argument("Unknown poker format version");
+	}
+	std::uint64_t players = detail::get_varint(p, end);
+	std::uint64_t decks = detail::get_varint(p, end);
+	if (players == 0 || players > 0xFFFFFFFFull || decks > poker_max_decks || p == end) {
+		throw std::invalid_argument("Malformed poker");
+	}
+	bool joker = *p++ != 0;
+	poker game(0, 1, false, pk.pile.get_allocator().resource());
+	p = detail::get_deck(p, end, game.pile);
+	if (players > static_cast<std::uint64_t>(end - p)) {
+		throw std::invalid_argument("Truncated poker");
+	}
+	game.players = static_cast<unsigned int>(players);
+	game.decks = static_cast<unsigned int>(decks);
+	game.joker = joker;
+	game.cut = pk.cut;
+	game.player_card.clear();
+	game.player_card.reserve(game.players);
+	for (unsigned int i = 0; i < game.players; ++i) {
+		game.player_card.emplace_back();
+		p = detail::get_deck(p, end, game.player_card.back());
+	}
+	pk = std::move(game);
+	return static_cast<std::size_t>(p - buf);
+}
+
+/** Parse a card in the format of operator<<, e.g. "♠  A", "♥ 10" or "JOKER"
+ * @param text The text
+ * @param pos The position to start from, advanced past the card
+ * @return The card
+ */
+inline card parse_card(std::string_view text, std::size_t& pos)
+{
+	while (pos < text.size() && text[pos] == ' ') {
+		++pos;
+	}
+	std::string_view rest = text.substr(pos);
+	if (rest.substr(0, 5) == card::cardname[14]) {
+		pos += 5;
+		return card{1, 14};
+	}
+	for (unsigned short suit = CLUB; suit <= SPADE; ++suit) {
+		std::string_view image{card::suit_image[suit]};
+		if (rest.substr(0, image.size()) != image) {
+			continue;
+		}
+		pos += image.size();
+		while (pos < text.size() && text[pos] == ' ') {
+			++pos;
+		}
+		if (text.substr(pos, 2) == "10") {
+			pos += 2;
+			return card{suit, 10};
+		}
+		if (pos < text.size()) {
+			for (unsigned short number = 1; number <= 13; ++number) {
+				if (card::cardname[number][0] == text[pos] && card::cardname[number][1] == '\0') {
+					++pos;
+					return card{suit, number};
+				}
+			}
+		}
+		throw std::invalid_argument("Unknown card rank");
+	}
+	throw std::invalid_argument("Unknown card suit");
+}
+
+/** Parse a deck printed in no_sort mode, e.g. "♠  A  ♥ 10  JOKER"
+ * @param text The text
+ * @param out The deck, replaced by the cards parsed
+ */
+inline void parse_deck(std::string_view text, deck& out)
+{
+	out.clear();
+	std::size_t pos = 0;
+	for (;;) {
+		while (pos < text.size() && (text[pos] == ' ' || text[pos] == '\n')) {
+			++pos;
+		}
+		if (pos == text.size()) {
+			return;
+		}
+		out.push_back(parse_card(text, pos));
+	}
+}
+
+} // namespace pk
+#endif // SERIALIZE_H_
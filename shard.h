@@ -0,0 +1,639 @@
+/* shard.h Copyright 2019, 2023 TNPLR
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef SHARD_H_
+#define SHARD_H_
+
+#include "poker.h"
+#include "equity.h"
+#include "serialize.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+/*
+ * Equity jobs split over machines
+ * An equity job is an equity_request with its mode decided, so that every machine
+ * agrees on the boards. Its boards are the batches of equity(): batch b is sampled
+ * from philox4x32(seed, b) or is the enumeration indices [b * 1024, (b + 1) * 1024).
+ * A shard is a range of batches, so any worker computes any shard alone, and the
+ * counts of the shards add up exactly to those of the whole job, in any order: a
+ * result keeps the ranges of batches it counts, and merging overlapping ones throws.
+ * E.g.
+ *     pk::equity_job job = pk::equity_job::of(req);
+ *     for (pk::equity_shard const& s : job.shards(64)) ... send encode(s) ...
+ *
+ *     // on a worker
+ *     pk::equity_shard s;
+ *     pk::decode(buf, len, s);
+ *     pk::shard_result r = pk::run_shard(s);
+ *     ... send encode(r) ...
+ *
+ *     // on the coordinator
+ *     pk::shard_result total;
+ *     total.merge(r);    // for every shard, as it arrives
+ *     pk::equity_result res = total.result(job);
+ *
+ * The counts are integers: for each player, the number of boards on which it is one
+ * of k best hands, for every k. The win, tie and share of the pot and its variance
+ * follow from them, so no floating point sum depends on the order of the merges.
+ *
+ * The wire format follows serialize.h:
+ *     equity_job    byte version (1), byte mode (1 sampled, 2 enumerated), varint players,
+ *                   card_set per player, board, dead, deck, varint boards, u64 seed, u64 z (IEEE 754)
+ *     equity_shard  equity_job, varint first batch, varint end batch
+ *     shard_result  byte version (1), u64 fingerprint of the job, varint players, varint ranges,
+ *                   varint first and end batch per range, varint boards, varint count per player and k
+ * A u64 is 8 bytes, little-endian.
+ */
+namespace pk {
+
+/** The version byte of an encoded job and shard result */
+constexpr unsigned char shard_format_version = 1;
+
+struct equity_shard;
+
+/** An equity request with its mode decided, the unit of distributed work */
+struct equity_job {
+	std::vector<card_set> hole; /**< Hole cards of each player */
+	card_set board; /**< Known board cards */
+	card_set dead; /**< Dead cards */
+	card_set deck = card_set::full(); /**< The cards boards are drawn from, before removing the others */
+	bool exact = false; /**< Whether the boards are enumerated rather than sampled */
+	std::uint64_t boards = 0; /**< The number of boards of the whole job */
+	std::uint64_t seed = 0; /**< The seed of the sampled boards */
+	double confidence_z = 1.96; /**< The z-score of the confidence interval */
+
+	/** Decide the mode of a request as equity() does
+	 * target_stderr and threads do not matter to a job: every shard runs to its end.
+	 * @param req The request
+	 * @return The job
+	 */
+	static equity_job of(equity_request const& req)
+	{
+		detail::check_request(req);
+		equity_job job;
+		job.hole = req.hole;
+		job.board = req.board;
+		job.dead = req.dead;
+		job.deck = req.deck & card_set::full();
+		job.seed = req.seed;
+		job.confidence_z = req.confidence_z;
+		const std::uint64_t all = detail::binomial(job.rest().size(), job.missing());
+		job.exact = req.mode == equity_mode::enumerate
+			|| (req.mode == equity_mode::automatic && all <= req.enumerate_limit);
+		job.boards = job.exact ? all : req.trials;
+		job.check();
+		return job;
+	}
+
+	/** @return The number of batches */
+	inline std::uint32_t batches() const
+	{
+		return static_cast<std::uint32_t>((boards + detail::equity_batch - 1) / detail::equity_batch);
+	}
+
+	/** @return The cards the boards are drawn from */
+	card_set rest() const
+	{
+		card_set known = board | dead;
+		for (card_set h : hole) {
+			known |= h;
+		}
+		return deck - known;
+	}
+
+	/** @return The number of board cards to draw */
+	inline unsigned int missing() const
+	{
+		return 5 - board.size();
+	}
+
+	/** Split the batches into ranges as even as possible
+	 * @param n The number of shards; fewer are returned if there are fewer batches
+	 * @return The shards, in the order of their batches
+	 */
+	std::vector<equity_shard> shards(std::uint32_t n) const;
+
+	/** @return A hash of the encoded job, to tell the results of jobs apart */
+	std::uint64_t fingerprint() const;
+
+	/** Throw if the job cannot be run */
+	void check() const
+	{
+		if (hole.empty() || board.size() > 5) {
+			throw std::invalid_argument("Malformed equity job");
+		}
+		if (deck.mask() & ~card_set::full_deck) {
+			throw std::invalid_argument("The deck of an equity job has jokers");
+		}
+		if (rest().size() < missing()) {
+			throw std::invalid_argument("Not enough cards left to complete the board");
+		}
+		if ((boards + detail::equity_batch - 1) / detail::equity_batch > 0xFFFFFFFFull) {
+			throw std::invalid_argument("Too many trials");
+		}
+		if (exact && boards != detail::binomial(rest().size(), missing())) {
+			throw std::invalid_argument("An enumerated job has every board");
+		}
+	}
+};
+
+/** A range [first, end) of the batches of a job */
+struct equity_shard {
+	equity_job job;
+	std::uint32_t first = 0;
+	std::uint32_t end = 0;
+};
+
+inline std::vector<equity_shard> equity_job::shards(std::uint32_t n) const
+{
+	const std::uint32_t total = batches();
+	if (n == 0) {
+		throw std::invalid_argument("At least one shard is needed");
+	}
+	n = n < total ? n : (total ? total : 1);
+	std::vector<equity_shard> out(n);
+	for (std::uint32_t i = 0; i < n; ++i) {
+		out[i].job = *this;
+		out[i].first = static_cast<std::uint32_t>(static_cast<std::uint64_t>(total) * i / n);
+		out[i].end = static_cast<std::uint32_t>(static_cast<std::uint64_t>(total) * (i + 1) / n);
+	}
+	return out;
+}
+
+/** The exact counts of the boards of one or more shards of a job */
+class shard_result {
+public:
+	/** A range [first, end) of batches */
+	using batch_range = std::pair<std::uint32_t, std::uint32_t>;
+
+	/** An empty result, which any shard result can be merged into */
+	shard_result() = default;
+
+	/** An empty result of a job over a range of batches */
+	shard_result(equity_job const& job, std::uint32_t first_batch, std::uint32_t end_batch)
+		: job_id{job.fingerprint()}, players{static_cast<unsigned int>(job.hole.size())},
+		split(static_cast<std::size_t>(players) * players)
+	{
+		if (first_batch < end_batch) {
+			ranges.push_back({first_batch, end_batch});
+		}
+	}
+
+	/** Add the counts of another result of the same job, in any order
+	 * @param rop The result, of batches none of which have been counted yet
+	 */
+	void merge(shard_result const& rop)
+	{
+		if (rop.players == 0) {
+			return;
+		}
+		if (players == 0) {
+			*this = rop;
+			return;
+		}
+		if (job_id != rop.job_id || players != rop.players) {
+			throw std::invalid_argument("The results are of different jobs");
+		}
+		std::vector<batch_range> all(ranges.size() + rop.ranges.size());
+		std::merge(ranges.begin(), ranges.end(), rop.ranges.begin(), rop.ranges.end(), all.begin());
+		std::vector<batch_range> joined;
+		for (batch_range const& r : all) {
+			if (!joined.empty() && r.first < joined.back().second) {
+				throw std::invalid_argument("The batches of the results overlap");
+			}
+			if (!joined.empty() && r.first == joined.back().second) {
+				joined.back().second = r.second;
+			} else {
+				joined.push_back(r);
+			}
+		}
+		ranges = std::move(joined);
+		boards += rop.boards;
+		for (std::size_t i = 0; i < split.size(); ++i) {
+			split[i] += rop.split[i];
+		}
+	}
+
+	/** Add the counts of several results of the same job, in any order
+	 * @param results The results
+	 */
+	void merge(std::vector<shard_result> const& results)
+	{
+		for (shard_result const& r : results) {
+			merge(r);
+		}
+	}
+
+	/** The equity over the boards counted
+	 * @param job The job
+	 * @return The result, exact if the job is enumerated and every batch has been merged
+	 */
+	equity_result result(equity_job const& job) const
+	{
+		if (players != 0 && job.fingerprint() != job_id) {
+			throw std::invalid_argument("The result is of another job");
+		}
+		if (!ranges.empty() && ranges.back().second > job.batches()) {
+			throw std::invalid_argument("The result is out of the batches of the job");
+		}
+		std::vector<detail::equity_tally> tally(players);
+		for (unsigned int p = 0; p < players; ++p) {
+			for (unsigned int k = 1; k <= players; ++k) {
+				const std::uint64_t n = split[p * players + k - 1];
+				(k == 1 ? tally[p].win : tally[p].tie) += n;
+				tally[p].share += static_cast<double>(n) / k;
+				tally[p].share_sq += static_cast<double>(n) / (static_cast<double>(k) * k);
+			}
+		}
+		equity_result res = detail::make_result(tally, boards, job.confidence_z);
+		if (job.exact && batch_count() == job.batches()) {
+			res.exact = true;
+			for (player_equity& pe : res.players) {
+				pe.std_error = 0;
+				pe.ci_low = pe.ci_high = pe.equity;
+			}
+		}
+		return res;
+	}
+
+	/** @return The number of boards counted */
+	inline std::uint64_t board_count() const
+	{
+		return boards;
+	}
+
+	/** @return The ranges [first, end) of the batches counted, ascending, neither overlapping nor touching */
+	inline std::vector<batch_range> const& batch_ranges() const
+	{
+		return ranges;
+	}
+
+	/** @return The number of batches counted */
+	std::uint64_t batch_count() const
+	{
+		std::uint64_t n = 0;
+		for (batch_range const& r : ranges) {
+			n += r.second - r.first;
+		}
+		return n;
+	}
+
+	/** @return The number of boards on which a player is one of k best hands
+	 * @param player The player
+	 * @param k The number of best hands, 1 being a win
+	 */
+	inline std::uint64_t count(unsigned int player, unsigned int k) const
+	{
+		return split.at(static_cast<std::size_t>(player) * players + k - 1);
+	}
+
+	bool operator==(shard_result const& rop) const
+	{
+		return job_id == rop.job_id && players == rop.players && ranges == rop.ranges
+			&& boards == rop.boards && split == rop.split;
+	}
+
+private:
+	friend shard_result run_shard(equity_shard const& shard, unsigned int threads);
+	friend std::size_t encoded_size(shard_result const& r);
+	friend std::size_t encode(shard_result const& r, unsigned char *buf, std::size_t cap);
+	friend std::size_t decode(unsigned char const *buf, std::size_t len, shard_result& out);
+
+	std::uint64_t job_id = 0; /**< The fingerprint of the job */
+	unsigned int players = 0; /**< The number of players, 0 for an empty result */
+	std::vector<batch_range> ranges; /**< The batches counted, see batch_ranges() */
+	std::uint64_t boards = 0;
+	std::vector<std::uint64_t> split; /**< For player p and k best hands, entry p * players + k - 1 */
+};
+
+namespace detail {
+inline unsigned char *put_u64_le(unsigned char *p, std::uint64_t v)
+{
+	for (int i = 0; i < 8; ++i) {
+		*p++ = static_cast<unsigned char>(v >> (8 * i));
+	}
+	return p;
+}
+
+inline std::uint64_t get_u64_le(unsigned char const *&p, unsigned char const *end)
+{
+	if (end - p < 8) {
+		throw std::invalid_argument("Truncated u64");
+	}
+	std::uint64_t v = 0;
+	for (int i = 0; i < 8; ++i) {
+		v |= static_cast<std::uint64_t>(*p++) << (8 * i);
+	}
+	return v;
+}
+
+inline unsigned char const *get_card_set(unsigned char const *p, unsigned char const *end, card_set& out)
+{
+	return p + decode(p, static_cast<std::size_t>(end - p), out);
+}
+
+/** Counts every board by the number of best hands each player shares */
+struct split_scorer {
+	std::uint64_t const *hole;
+	unsigned int players;
+	std::uint64_t *split;
+	hand_strength *strength;
+
+	inline void operator()(std::uint64_t board)
+	{
+		hand_strength best = 0;
+		for (unsigned int p = 0; p < players; ++p) {
+			const std::uint64_t m = hole[p] | board;
+			strength[p] = evaluate_masks(m & 0x1FFF, m >> 16 & 0x1FFF, m >> 32 & 0x1FFF, m >> 48 & 0x1FFF, tables());
+			best = strength[p] > best ? strength[p] : best;
+		}
+		unsigned int winners = 0;
+		for (unsigned int p = 0; p < players; ++p) {
+			winners += strength[p] == best;
+		}
+		for (unsigned int p = 0; p < players; ++p) {
+			split[p * players + winners - 1] += strength[p] == best;
+		}
+	}
+};
+} // namespace detail
+
+/** @return The number of bytes of an encoded job */
+inline std::size_t encoded_size(equity_job const& job)
+{
+	return 2 + detail::varint_size(job.hole.size()) + 8 * (job.hole.size() + 3) + detail::varint_size(job.boards) + 16;
+}
+
+/** Encode a job
+ * @param job The job
+ * @param buf The buffer
+ * @param cap The size of the buffer
+ * @return The number of bytes written
+ */
+inline std::size_t encode(equity_job const& job, unsigned char *buf, std::size_t cap)
+{
+	detail::check_space(encoded_size(job), cap);
+	unsigned char *p = buf;
+	*p++ = shard_format_version;
+	*p++ = job.exact ? 2 : 1;
+	p = detail::put_varint(p, job.hole.size());
+	for (card_set h : job.hole) {
+		p += encode(h, p, 8);
+	}
+	p += encode(job.board, p, 8);
+	p += encode(job.dead, p, 8);
+	p += encode(job.deck, p, 8);
+	p = detail::put_varint(p, job.boards);
+	p = detail::put_u64_le(p, job.seed);
+	std::uint64_t z;
+	std::memcpy(&z, &job.confidence_z, 8);
+	p = detail::put_u64_le(p, z);
+	return static_cast<std::size_t>(p - buf);
+}
+
+/** Decode a job
+ * @param buf The buffer
+ * @param len The size of the buffer
+ * @param out The job
+ * @return The number of bytes consumed
+ */
+inline std::size_t decode(unsigned char const *buf, std::size_t len, equity_job& out)
+{
+	unsigned char const *p = buf, *end = buf + len;
+	if (end - p < 2 || *p++ != shard_format_version) {
+		throw std::invalid_argument("Unknown equity job format version");
+	}
+	const unsigned char mode = *p++;
+	if (mode != 1 && mode != 2) {
+		throw std::invalid_argument("Malformed equity job");
+	}
+	const std::uint64_t players = detail::get_varint(p, end);
+	if (players == 0 || players > 52) {
+		throw std::invalid_argument("Malformed equity job");
+	}
+	equity_job job;
+	job.exact = mode == 2;
+	job.hole.resize(players);
+	for (card_set& h : job.hole) {
+		p = detail::get_card_set(p, end, h);
+	}
+	p = detail::get_card_set(p, end, job.board);
+	p = detail::get_card_set(p, end, job.dead);
+	p = detail::get_card_set(p, end, job.deck);
+	job.boards = detail::get_varint(p, end);
+	job.seed = detail::get_u64_le(p, end);
+	const std::uint64_t z = detail::get_u64_le(p, end);
+	std::memcpy(&job.confidence_z, &z, 8);
+
+	equity_request req;
+	req.hole = job.hole;
+	req.board = job.board;
+	req.dead = job.dead;
+	detail::check_request(req);
+	job.check();
+	out = std::move(job);
+	return static_cast<std::size_t>(p - buf);
+}
+
+inline std::uint64_t equity_job::fingerprint() const
+{
+	std::vector<unsigned char> buf(encoded_size(*this));
+	encode(*this, buf.data(), buf.size());
+	// FNV-1a
+	std::uint64_t h = 0xCBF29CE484222325ull;
+	for (unsigned char c : buf) {
+		h = (h ^ c) * 0x100000001B3ull;
+	}
+	return h;
+}
+
+/** @return The number of bytes of an encoded shard */
+inline std::size_t encoded_size(equity_shard const& s)
+{
+	return encoded_size(s.job) + detail::varint_size(s.first) + detail::varint_size(s.end);
+}
+
+/** Encode a shard
+ * @param s The shard
+ * @param buf The buffer
+ * @param cap The size of the buffer
+ * @return The number of bytes written
+ */
+inline std::size_t encode(equity_shard const& s, unsigned char *buf, std::size_t cap)
+{
+	detail::check_space(encoded_size(s), cap);
+	unsigned char *p = buf + encode(s.job, buf, cap);
+	p = detail::put_varint(p, s.first);
+	p = detail::put_varint(p, s.end);
+	return static_cast<std::size_t>(p - buf);
+}
+
+/** Decode a shard
+ * @param buf The buffer
+ * @param len The size of the buffer
+ * @param out The shard
+ * @return The number of bytes consumed
+ */
+inline std::size_t decode(unsigned char const *buf, std::size_t len, equity_shard& out)
+{
+	equity_shard s;
+	unsigned char const *p = buf + decode(buf, len, s.job), *end = buf + len;
+	const std::uint64_t first = detail::get_varint(p, end);
+	const std::uint64_t last = detail::get_varint(p, end);
+	if (first > last || last > s.job.batches()) {
+		throw std::invalid_argument("Malformed equity shard");
+	}
+	s.first = static_cast<std::uint32_t>(first);
+	s.end = static_cast<std::uint32_t>(last);
+	out = std::move(s);
+	return static_cast<std::size_t>(p - buf);
+}
+
+/** @return The number of bytes of an encoded result */
+inline std::size_t encoded_size(shard_result const& r)
+{
+	std::size_t n = 1 + 8 + detail::varint_size(r.players) + detail::varint_size(r.ranges.size())
+		+ detail::varint_size(r.boards);
+	for (shard_result::batch_range const& b : r.ranges) {
+		n += detail::varint_size(b.first) + detail::varint_size(b.second);
+	}
+	for (std::uint64_t c : r.split) {
+		n += detail::varint_size(c);
+	}
+	return n;
+}
+
+/** Encode a result
+ * @param r The result
+ * @param buf The buffer
+ * @param cap The size of the buffer
+ * @return The number of bytes written
+ */
+inline std::size_t encode(shard_result const& r, unsigned char *buf, std::size_t cap)
+{
+	detail::check_space(encoded_size(r), cap);
+	unsigned char *p = buf;
+	*p++ = shard_format_version;
+	p = detail::put_u64_le(p, r.job_id);
+	p = detail::put_varint(p, r.players);
+	p = detail::put_varint(p, r.ranges.size());
+	for (shard_result::batch_range const& b : r.ranges) {
+		p = detail::put_varint(p, b.first);
+		p = detail::put_varint(p, b.second);
+	}
+	p = detail::put_varint(p, r.boards);
+	for (std::uint64_t c : r.split) {
+		p = detail::put_varint(p, c);
+	}
+	return static_cast<std::size_t>(p - buf);
+}
+
+/** Decode a result
+ * @param buf The buffer
+ * @param len The size of the buffer
+ * @param out The result
+ * @return The number of bytes consumed
+ */
+inline std::size_t decode(unsigned char const *buf, std::size_t len, shard_result& out)
+{
+	unsigned char const *p = buf, *end = buf + len;
+	if (p == end || *p++ != shard_format_version) {
+		throw std::invalid_argument("Unknown shard result format version");
+	}
+	shard_result r;
+	r.job_id = detail::get_u64_le(p, end);
+	const std::uint64_t players = detail::get_varint(p, end);
+	const std::uint64_t ranges = detail::get_varint(p, end);
+	if (players > 52 || ranges > static_cast<std::uint64_t>(end - p) / 2) {
+		throw std::invalid_argument("Malformed shard result");
+	}
+	r.players = static_cast<unsigned int>(players);
+	std::uint64_t prev = 0;
+	for (std::uint64_t i = 0; i < ranges; ++i) {
+		const std::uint64_t first = detail::get_varint(p, end);
+		const std::uint64_t last = detail::get_varint(p, end);
+		// Ranges are ascending and apart: touching ones are joined by merge()
+		if (first >= last || last > 0xFFFFFFFFull || (i > 0 && first <= prev)) {
+			throw std::invalid_argument("Malformed shard result");
+		}
+		r.ranges.push_back({static_cast<std::uint32_t>(first), static_cast<std::uint32_t>(last)});
+		prev = last;
+	}
+	r.boards = detail::get_varint(p, end);
+	r.split.resize(static_cast<std::size_t>(players * players));
+	for (std::uint64_t& c : r.split) {
+		c = detail::get_varint(p, end);
+	}
+	out = std::move(r);
+	return static_cast<std::size_t>(p - buf);
+}
+
+/** Count the boards of a shard
+ * The counts depend only on the shard, not on the number of threads.
+ * @param shard The shard
+ * @param threads The number of workers. 0 is one per hardware thread. Default to 0.
+ * @return The counts
+ */
+inline shard_result run_shard(equity_shard const& shard, unsigned int threads = 0)
+{
+	equity_job const& job = shard.job;
+	job.check();
+	if (shard.first > shard.end || shard.end > job.batches()) {
+		throw std::invalid_argument("The shard is out of the batches of the job");
+	}
+	const unsigned int players = static_cast<unsigned int>(job.hole.size());
+	const card_set rest = job.rest();
+	detail::sample_plan plan{job.seed, job.boards, job.board.mask(), job.missing(), players, 0, {}};
+	for (std::uint64_t m = rest.mask(); m; m &= m - 1) {
+		plan.deck[plan.deck_size++] = static_cast<std::uint8_t>(detail::ctz64(m));
+	}
+	std::vector<std::uint64_t> hole(players);
+	for (unsigned int p = 0; p < players; ++p) {
+		hole[p] = job.hole[p].mask();
+	}
+
+	const std::uint32_t count = shard.end - shard.first;
+	const unsigned int workers = detail::worker_count(threads, count);
+	detail::work_ranges ranges(workers, count);
+	std::vector<shard_result> partial(workers, shard_result(job, shard.first, shard.end));
+	detail::run_workers(workers, [&](unsigned int w) {
+		shard_result& r = partial[w];
+		std::vector<hand_strength> strength(players);
+		detail::split_scorer score{hole.data(), players, r.split.data(), strength.data()};
+		std::uint32_t i;
+		while (ranges.next(w, i)) {
+			const std::uint32_t b = shard.first + i;
+			r.boards += job.exact ? detail::enumerate_boards(plan, b, score) : detail::sample_boards(plan, b, score);
+		}
+	});
+
+	shard_result res(job, shard.first, shard.end);
+	for (shard_result const& r : partial) {
+		res.boards += r.boards;
+		for (std::size_t i = 0; i < res.split.size(); ++i) {
+			res.split[i] += r.split[i];
+		}
+	}
+	return res;
+}
+
+} // namespace pk
+#endif // SHARD_H_
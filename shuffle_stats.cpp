@@ -0,0 +1,223 @@
+/* shuffle_stats.cpp Copyright 2019, 2023 TNPLR
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Uniformity and speed of the shuffles
+ *     g++ -std=c++17 -O2 shuffle_stats.cpp poker.cpp -o shuffle_stats
+ *     ./shuffle_stats [--shuffles=N] [--only=NAME] [--alpha=P] [--seed=S]
+ * The speed is timed over at most 100000 shuffles (with a reset() each), apart
+ * from the counting. Every shuffle of a 52-card pile is counted into the matrix
+ * of card by position.
+ * Under a uniform shuffle each cell is binomial(N, 1/52), so three tests are run:
+ *     matrix    chi-square of all 52 * 52 cells, with 51 * 51 degrees of freedom
+ *     position  the worst chi-square of one position, Bonferroni-corrected
+ *     parity    the fraction of even permutations against 1/2
+ * Only the Fisher-Yates shuffles decide the exit status, 1 if any fails a test.
+ * The random swaps and shuffle() are reported for reference: every swap is a
+ * transposition, so the parity of the result is the parity of the swap count.
+ * The "naive" shuffle (swap card i with any card) is a known biased control.
+ */
+#include "poker.h"
+#include "rng.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr unsigned int cards = 52;
+
+/** @return The upper tail probability of a chi-square, by the Wilson-Hilferty approximation */
+double chi_square_p(double x, double df)
+{
+	const double v = 2.0 / (9.0 * df);
+	const double z = (std::cbrt(x / df) - (1.0 - v)) / std::sqrt(v);
+	return 0.5 * std::erfc(z / std::sqrt(2.0));
+}
+
+/** @return The index of a card, 0 to 51 */
+unsigned int card_index(pk::card const& c)
+{
+	return c.suit * 13u + c.number - 1u;
+}
+
+/** @return Whether a permutation of 0 to 51 is even */
+bool even_permutation(unsigned int const *perm)
+{
+	bool seen[cards]{};
+	unsigned int cycles = 0;
+	for (unsigned int i = 0; i < cards; ++i) {
+		if (seen[i]) {
+			continue;
+		}
+		++cycles;
+		for (unsigned int j = i; !seen[j]; j = perm[j]) {
+			seen[j] = true;
+		}
+	}
+	return (cards - cycles) % 2 == 0;
+}
+
+struct shuffle_case {
+	std::string name;
+	char const *note; /**< Why the result does not decide the exit status, or nullptr */
+	std::function<void(pk::poker&)> run;
+};
+
+struct statistics {
+	double matrix_chi2, matrix_p;
+	double position_chi2, position_p;
+	double even_fraction, parity_p;
+};
+
+statistics measure(shuffle_case const& sc, unsigned long shuffles)
+{
+	std::vector<std::uint64_t> counts(cards * cards);
+	std::uint64_t even = 0;
+	pk::poker game(1, 1);
+	unsigned int perm[cards];
+	for (unsigned long n = 0; n < shuffles; ++n) {
+		game.reset();
+		sc.run(game);
+		pk::deck const& pile = game.card_pile();
+		for (unsigned int pos = 0; pos < cards; ++pos) {
+			perm[pos] = card_index(pile[pos]);
+			++counts[pos * cards + perm[pos]];
+		}
+		even += even_permutation(perm);
+	}
+
+	statistics st{};
+	const double expected = static_cast<double>(shuffles) / cards;
+	double worst = 0;
+	for (unsigned int pos = 0; pos < cards; ++pos) {
+		double chi2 = 0;
+		for (unsigned int c = 0; c < cards; ++c) {
+			const double d = counts[pos * cards + c] - expected;
+			chi2 += d * d / expected;
+		}
+		st.matrix_chi2 += chi2;
+		if (chi2 > worst) {
+			worst = chi2;
+		}
+	}
+	st.matrix_p = chi_square_p(st.matrix_chi2, (cards - 1.0) * (cards - 1.0));
+	st.position_chi2 = worst;
+	st.position_p = std::fmin(1.0, chi_square_p(worst, cards - 1.0) * cards);
+	st.even_fraction = static_cast<double>(even) / shuffles;
+	const double z = (st.even_fraction - 0.5) / std::sqrt(0.25 / shuffles);
+	st.parity_p = std::erfc(std::fabs(z) / std::sqrt(2.0));
+	return st;
+}
+
+/** @return The shuffles per second, without the counting of measure() */
+double throughput(shuffle_case const& sc, unsigned long shuffles)
+{
+	pk::poker game(1, 1);
+	auto start = std::chrono::steady_clock::now();
+	for (unsigned long n = 0; n < shuffles; ++n) {
+		game.reset();
+		sc.run(game);
+	}
+	auto stop = std::chrono::steady_clock::now();
+	return shuffles / std::chrono::duration<double>(stop - start).count();
+}
+
+/** @return The value of a --name=value argument, or an empty string */
+std::string flag(int argc, char **argv, char const *name)
+{
+	const std::string prefix = std::string("--") + name + "=";
+	for (int i = 1; i < argc; ++i) {
+		if (std::strncmp(argv[i], prefix.c_str(), prefix.size()) == 0) {
+			return argv[i] + prefix.size();
+		}
+	}
+	return "";
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+	const std::string shuffles_flag = flag(argc, argv, "shuffles");
+	const std::string alpha_flag = flag(argc, argv, "alpha");
+	const std::string seed_flag = flag(argc, argv, "seed");
+	const std::string only = flag(argc, argv, "only");
+	const unsigned long shuffles = shuffles_flag.empty() ? 1000000ul : std::strtoul(shuffles_flag.c_str(), nullptr, 10);
+	const double alpha = alpha_flag.empty() ? 1e-4 : std::atof(alpha_flag.c_str());
+	const std::uint64_t seed = seed_flag.empty() ? 20190101u : std::strtoull(seed_flag.c_str(), nullptr, 10);
+	if (shuffles == 0) {
+		std::cerr << "--shuffles must be positive\n";
+		return 1;
+	}
+
+	using mode = pk::poker::shuffle_mode;
+	std::mt19937_64 mt(seed);
+	pk::xoshiro256ss xoshiro(seed);
+	pk::pcg64 pcg(seed);
+	pk::philox4x32 philox(seed);
+	std::vector<shuffle_case> cases{
+		{"fisher_yates/mt19937_64", nullptr, [&](pk::poker& g) { g.shuffle(mt); }},
+		{"fisher_yates/xoshiro256ss", nullptr, [&](pk::poker& g) { g.shuffle(xoshiro); }},
+		{"fisher_yates/pcg64", nullptr, [&](pk::poker& g) { g.shuffle(pcg); }},
+		{"fisher_yates/philox4x32", nullptr, [&](pk::poker& g) { g.shuffle(philox); }},
+		{"random_swap/1000/mt19937_64", "reference", [&](pk::poker& g) { g.shuffle(mt, mode::random_swap, 1000); }},
+		{"random_swap/1001/mt19937_64", "reference", [&](pk::poker& g) { g.shuffle(mt, mode::random_swap, 1001); }},
+		{"shuffle()", "reference", [](pk::poker& g) { g.shuffle(); }},
+		{"naive", "control, expected to fail", [&](pk::poker& g) {
+			pk::deck& pile = const_cast<pk::deck&>(g.card_pile());
+			for (unsigned int i = 0; i < cards; ++i) {
+				std::swap(pile[i], pile[pk::detail::bounded_rand(xoshiro, cards)]);
+			}
+		}},
+	};
+
+	std::cout << "shuffles " << shuffles << ", alpha " << alpha << ", seed " << seed << "\n\n"
+		<< std::left << std::setw(30) << "shuffle" << std::right
+		<< std::setw(14) << "shuffles/s"
+		<< std::setw(12) << "matrix p"
+		<< std::setw(12) << "position p"
+		<< std::setw(10) << "even"
+		<< std::setw(12) << "parity p" << "  result\n";
+	int status = 0;
+	for (shuffle_case const& sc : cases) {
+		if (!only.empty() && sc.name.find(only) == std::string::npos) {
+			continue;
+		}
+		const double speed = throughput(sc, shuffles < 100000 ? shuffles : 100000);
+		statistics st = measure(sc, shuffles);
+		const bool pass = st.matrix_p >= alpha && st.position_p >= alpha && st.parity_p >= alpha;
+		std::cout << std::left << std::setw(30) << sc.name << std::right
+			<< std::setw(14) << std::fixed << std::setprecision(0) << speed
+			<< std::setw(12) << std::scientific << std::setprecision(2) << st.matrix_p
+			<< std::setw(12) << st.position_p
+			<< std::setw(10) << std::fixed << std::setprecision(4) << st.even_fraction
+			<< std::setw(12) << std::scientific << std::setprecision(2) << st.parity_p
+			<< "  " << (pass ? "pass" : "FAIL") << (sc.note ? std::string(" (") + sc.note + ")" : "") << '\n';
+		if (!pass && !sc.note) {
+			status = 1;
+		}
+	}
+	return status;
+}
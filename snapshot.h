@@ -0,0 +1,243 @@
+/* snapshot.h Copyright 2019, 2023 TNPLR
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef SNAPSHOT_H_
+#define SNAPSHOT_H_
+
+#include "poker.h"
+#include "rng.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+/*
+ * Snapshots of games in memory, to fork a game and explore alternatives
+ * E.g.
+ *     pk::poker_snapshot root;
+ *     root.save(game, generator);
+ *     for (...) {
+ *         root.restore(game, generator);
+ *         ... play one line ...
+ *     }
+ *
+ * A snapshot is flat: every card of the pile and of the hands is in one array,
+ * copied with memcpy, and the engine is kept as its bytes. Saving into the same
+ * snapshot and restoring into the same game reuse their storage, so a fork
+ * allocates nothing once both are large enough.
+ *
+ * For replay, a shuffle_log gives every shuffle its own philox4x32 stream, and
+ * records the seed and stream, so any shuffle can be done again alone.
+ */
+namespace pk {
+
+static_assert(std::is_trivially_copyable<card>::value, "Snapshots copy cards with memcpy");
+
+/** The seed and stream of a shuffle: philox4x32(seed, stream) gives it again */
+struct shuffle_record {
+	std::uint64_t seed;
+	std::uint64_t stream;
+
+	bool operator==(shuffle_record const& rop) const
+	{
+		return seed == rop.seed && stream == rop.stream;
+	}
+};
+
+/** Shuffle a game with the engine of a record
+ * @param pk The game
+ * @param r The record
+ */
+inline void shuffle(poker& pk, shuffle_record const& r)
+{
+	philox4x32 generator(r.seed, r.stream);
+	pk.shuffle(generator);
+}
+
+/** The shuffles of a session, each from its own stream of one seed */
+class shuffle_log {
+public:
+	/** @param s The seed of every shuffle */
+	explicit shuffle_log(std::uint64_t s = 0) : seed{s}
+	{
+	}
+
+	/** Shuffle a game with the next stream
+	 * @param pk The game
+	 * @return The record of the shuffle
+	 */
+	shuffle_record shuffle(poker& pk)
+	{
+		shuffle_record r{seed, records.size()};
+		pk::shuffle(pk, r);
+		records.push_back(r);
+		return r;
+	}
+
+	/** @return The records, in the order of the shuffles */
+	inline std::vector<shuffle_record> const& shuffles() const
+	{
+		return records;
+	}
+
+	/** Forget the shuffles after the first n, e.g. to replay from there
+	 * @param n The number of shuffles kept
+	 */
+	void truncate(std::size_t n)
+	{
+		if (n < records.size()) {
+			records.resize(n);
+		}
+	}
+
+private:
+	std::uint64_t seed;
+	std::vector<shuffle_record> records;
+};
+
+namespace detail {
+/** @return An address unique to a type, which tells the engines of snapshots apart */
+template <class T>
+inline void const *type_tag()
+{
+	static const char tag = 0;
+	return &tag;
+}
+} // namespace detail
+
+/** The state of a game: the layout, the cut card, the pile and every hand, and optionally an engine */
+class poker_snapshot {
+public:
+	poker_snapshot() = default;
+
+	/** Save a game
+	 * @param pk The game
+	 */
+	explicit poker_snapshot(poker const& pk)
+	{
+		save(pk);
+	}
+
+	/** Save a game, replacing the snapshot
+	 * @param pk The game
+	 */
+	void save(poker const& pk)
+	{
+		players = pk.players;
+		decks = pk.decks;
+		joker = pk.joker;
+		cut = pk.cut;
+		sizes.resize(players + 1);
+		std::size_t total = pk.pile.size();
+		sizes[0] = static_cast<std::uint32_t>(pk.pile.size());
+		for (unsigned int i = 0; i < players; ++i) {
+			sizes[i + 1] = static_cast<std::uint32_t>(pk.player_card[i].size());
+			total += pk.player_card[i].size();
+		}
+		cards.resize(total);
+		card *p = cards.data();
+		p = copy_out(pk.pile, p);
+		for (deck const& hand : pk.player_card) {
+			p = copy_out(hand, p);
+		}
+		engine.clear();
+		engine_type = nullptr;
+	}
+
+	/** Save a game and its engine, replacing the snapshot
+	 * @param pk The game
+	 * @param generator The engine, which must be trivially copyable (every engine of rng.h and <random> is)
+	 */
+	template <class URBG>
+	void save(poker const& pk, URBG const& generator)
+	{
+		static_assert(std::is_trivially_copyable<URBG>::value, "The engine must be trivially copyable");
+		save(pk);
+		engine.resize(sizeof(URBG));
+		std::memcpy(engine.data(), &generator, sizeof(URBG));
+		engine_type = detail::type_tag<URBG>();
+	}
+
+	/** Restore the saved state into a game, reusing its storage
+	 * @param pk The game
+	 */
+	void restore(poker& pk) const
+	{
+		if (sizes.empty()) {
+			throw std::logic_error("Nothing has been saved in the snapshot");
+		}
+		pk.players = players;
+		pk.decks = decks;
+		pk.joker = joker;
+		pk.cut = cut;
+		while (pk.player_card.size() > players) {
+			pk.player_card.pop_back();
+		}
+		while (pk.player_card.size() < players) {
+			pk.player_card.emplace_back();
+		}
+		card const *p = cards.data();
+		pk.pile.assign(p, p + sizes[0]);
+		p += sizes[0];
+		for (unsigned int i = 0; i < players; ++i) {
+			pk.player_card[i].assign(p, p + sizes[i + 1]);
+			p += sizes[i + 1];
+		}
+	}
+
+	/** Restore the saved state into a game and an engine
+	 * @param pk The game
+	 * @param generator The engine, of the type saved
+	 */
+	template <class URBG>
+	void restore(poker& pk, URBG& generator) const
+	{
+		static_assert(std::is_trivially_copyable<URBG>::value, "The engine must be trivially copyable");
+		if (engine_type != detail::type_tag<URBG>()) {
+			throw std::invalid_argument("The snapshot holds no engine of this type");
+		}
+		restore(pk);
+		std::memcpy(&generator, engine.data(), sizeof(URBG));
+	}
+
+	/** @return The number of cards saved, of the pile and every hand */
+	inline std::size_t card_count() const
+	{
+		return cards.size();
+	}
+
+private:
+	static card *copy_out(deck const& dk, card *out)
+	{
+		if (dk.size()) {
+			std::memcpy(static_cast<void *>(out), dk.data(), dk.size() * sizeof(card));
+		}
+		return out + dk.size();
+	}
+
+	unsigned int players = 0;
+	unsigned int decks = 0;
+	bool joker = false;
+	unsigned int cut = 0;
+	std::vector<std::uint32_t> sizes; /**< The size of the pile, then of each hand */
+	std::vector<card> cards; /**< The pile, then each hand */
+	std::vector<unsigned char> engine; /**< The bytes of the engine, if one was saved */
+	void const *engine_type = nullptr; /**< The type_tag() of the engine, if one was saved */
+};
+
+} // namespace pk
+#endif // SNAPSHOT_H_
@@ -0,0 +1,541 @@
+/* table_service.h Copyright 2019, 2023 TNPLR
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef TABLE_SERVICE_H_
+#define TABLE_SERVICE_H_
+
+#include "poker.h"
+#include "rng.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/*
+ * Many tables served by a fixed set of worker threads
+ * A poker game is not thread-safe. Here every table is owned by one shard, and only
+ * the worker of the shard touches it: every command on the table is queued to the
+ * shard and run there in order, so no game needs a lock.
+ * E.g.
+ *     pk::table_service service;
+ *     pk::table_id t = service.create_table(1, 9);
+ *     service.shuffle(t);
+ *     service.deal(t, 2);
+ *     std::future<pk::card> c = service.draw(t, 0);
+ *     service.submit(t, [](pk::table& tb) { tb.game.sort_player_card(); });
+ *
+ * Each shard has a bounded lock-free multi-producer single-consumer queue. A
+ * worker with nothing to do sleeps on a condition variable; producers take its
+ * mutex only to wake it.
+ */
+namespace pk {
+
+/** The size of a cache line, the alignment of state written by different threads */
+constexpr std::size_t cache_line = 64;
+
+/** A table of a table_service */
+struct alignas(cache_line) table {
+	table(unsigned int deck, unsigned int player, bool joker, std::uint64_t seed)
+		: game{deck, player, joker}, generator{seed}
+	{
+	}
+
+	poker game;
+	xoshiro256ss generator; /**< The engine of shuffle() */
+};
+
+/** The handle of a table: its shard and its index in the shard */
+struct table_id {
+	std::uint32_t shard;
+	std::uint32_t index;
+
+	bool operator==(table_id const& rop) const
+	{
+		return shard == rop.shard && index == rop.index;
+	}
+};
+
+/** The options of a table_service */
+struct table_service_options {
+	unsigned int shards = 0; /**< The number of worker threads. 0 is one per hardware thread. */
+	std::size_t queue_capacity = 4096; /**< The commands each shard can hold, rounded up to a power of 2 */
+	std::uint64_t seed = 0; /**< The seed of the engines of the tables */
+	/** Called on the worker with the exception of a command run by submit(), or of the creation
+	 * of a table. An exception of a command run by call() goes to its future instead. Default to ignore it.
+	 */
+	std::function<void(table_id, std::exception_ptr)> on_error;
+};
+
+namespace detail {
+/**
+ * A bounded queue, lock-free for any number of producers and one consumer
+ * The ring of D. Vyukov: the sequence number of a cell says whether it is free
+ * for the producer of ticket n (sequence n) or full for the consumer (n + 1).
+ */
+template <class T>
+class mpsc_queue {
+public:
+	explicit mpsc_queue(std::size_t capacity)
+	{
+		std::size_t n = 2;
+		while (n < capacity) {
+			n <<= 1;
+		}
+		mask = n - 1;
+		cells.reset(new cell[n]);
+		for (std::size_t i = 0; i < n; ++i) {
+			cells[i].sequence.store(i, std::memory_order_relaxed);
+		}
+	}
+
+	/** Add an element, from any thread
+	 * @return Whether there was room for it
+	 */
+	bool try_push(T&& value)
+	{
+		std::size_t pos = tail.load(std::memory_order_relaxed);
+		cell *c;
+		for (;;) {
+			c = &cells[pos & mask];
+			const std::size_t seq = c->sequence.load(std::memory_order_acquire);
+			const std::ptrdiff_t dif = static_cast<std::ptrdiff_t>(seq - pos);
+			if (dif == 0) {
+				if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+					break;
+				}
+			} else if (dif < 0) {
+				return false;
+			} else {
+				pos = tail.load(std::memory_order_relaxed);
+			}
+		}
+		c->value = std::move(value);
+		c->sequence.store(pos + 1, std::memory_order_release);
+		return true;
+	}
+
+	/** Take the oldest element, from the consumer thread only
+	 * @return Whether there was one
+	 */
+	bool try_pop(T& out)
+	{
+		cell& c = cells[head & mask];
+		if (c.sequence.load(std::memory_order_acquire) != head + 1) {
+			return false;
+		}
+		out = std::move(c.value);
+		c.value = T{};
+		c.sequence.store(head + mask + 1, std::memory_order_release);
+		++head;
+		return true;
+	}
+
+	/** @return Whether the queue is empty, from the consumer thread only */
+	bool empty() const
+	{
+		return cells[head & mask].sequence.load(std::memory_order_acquire) != head + 1;
+	}
+
+private:
+	struct cell {
+		std::atomic<std::size_t> sequence;
+		T value;
+	};
+
+	std::unique_ptr<cell[]> cells;
+	std::size_t mask;
+	alignas(cache_line) std::size_t head = 0; /**< The next ticket to pop, of the consumer */
+	alignas(cache_line) std::atomic<std::size_t> tail{0}; /**< The next ticket to push */
+};
+
+/** @return The table of a command, which is nullptr if the table was erased or could not be created */
+inline table& table_of(table *tb)
+{
+	if (!tb) {
+		throw std::out_of_range("The table was erased or could not be created");
+	}
+	return *tb;
+}
+
+/** A move-only function taking table *, see table_of()
+ * Unlike std::function it holds callables which cannot be copied, such as a lambda owning a promise.
+ */
+class table_task {
+public:
+	table_task() = default;
+
+	template <class F, class = std::enable_if_t<!std::is_same_v<std::decay_t<F>, table_task>>>
+	table_task(F&& fn) : impl{new model<std::decay_t<F>>{std::forward<F>(fn)}}
+	{
+	}
+
+	/** @return Whether there is a function */
+	explicit operator bool() const
+	{
+		return static_cast<bool>(impl);
+	}
+
+	void operator()(table *tb)
+	{
+		impl->run(tb);
+	}
+
+private:
+	struct callable {
+		virtual ~callable() = default;
+		virtual void run(table *tb) = 0;
+	};
+
+	template <class F>
+	struct model final : callable {
+		template <class G>
+		explicit model(G&& g) : fn(std::forward<G>(g))
+		{
+		}
+
+		void run(table *tb) override
+		{
+			fn(tb);
+		}
+
+		F fn;
+	};
+
+	std::unique_ptr<callable> impl;
+};
+
+/** A command for the worker of a shard */
+struct table_command {
+	enum class kind {
+		run, /**< Run fn on the table */
+		create, /**< Create the table */
+		erase, /**< Destroy the table */
+	};
+
+	kind what = kind::run;
+	std::uint32_t index = 0;
+	unsigned int deck = 0, player = 0;
+	bool joker = false;
+	std::uint64_t seed = 0;
+	table_task fn;
+};
+} // namespace detail
+
+/**
+ * A set of tables sharded over worker threads
+ * Every member function may be called from any thread. Commands on one table run
+ * in the order they were queued by one thread; commands queued by different threads
+ * are ordered by the queue.
+ */
+class table_service {
+public:
+	/** Start the workers
+	 * @param opt The options
+	 */
+	explicit table_service(table_service_options opt = {}) : options{std::move(opt)}
+	{
+		unsigned int n = options.shards ? options.shards : std::thread::hardware_concurrency();
+		if (n == 0) {
+			n = 1;
+		}
+		shards.reserve(n);
+		for (unsigned int s = 0; s < n; ++s) {
+			shards.emplace_back(new shard{options.queue_capacity});
+		}
+		for (unsigned int s = 0; s < n; ++s) {
+			shards[s]->worker = std::thread{[this, s] { run(s); }};
+		}
+	}
+
+	table_service(table_service const&) = delete;
+	table_service& operator=(table_service const&) = delete;
+
+	/** Run every queued command, then stop the workers */
+	~table_service()
+	{
+		stopping.store(true, std::memory_order_seq_cst);
+		for (auto& sh : shards) {
+			wake(*sh, true);
+		}
+		for (auto& sh : shards) {
+			sh->worker.join();
+		}
+	}
+
+	/** @return The number of shards */
+	inline unsigned int shard_count() const
+	{
+		return static_cast<unsigned int>(shards.size());
+	}
+
+	/** Create a table on the next shard, round robin
+	 * The table exists for every command queued after this returns.
+	 * @param deck The number of decks of the pile. Default to 1.
+	 * @param player The players of the table. Default to 2.
+	 * @param joker Whether the jokers should be put into the pile. Default to false.
+	 * @return The handle of the table
+	 */
+	table_id create_table(unsigned int deck = 1, unsigned int player = 2, bool joker = false)
+	{
+		if (player == 0) {
+			throw std::invalid_argument("Argument \'player\' cannot be zero");
+		}
+		const std::uint64_t n = created.fetch_add(1, std::memory_order_relaxed);
+		const std::uint32_t s = static_cast<std::uint32_t>(n % shards.size());
+		table_id id{s, shards[s]->next_index.fetch_add(1, std::memory_order_relaxed)};
+		std::uint64_t seed = options.seed + n;
+		detail::table_command cmd;
+		cmd.what = detail::table_command::kind::create;
+		cmd.index = id.index;
+		cmd.deck = deck;
+		cmd.player = player;
+		cmd.joker = joker;
+		cmd.seed = splitmix64(seed);
+		push(s, std::move(cmd));
+		return id;
+	}
+
+	/** Destroy a table once the commands queued before have run
+	 * @param id The table
+	 */
+	void erase_table(table_id id)
+	{
+		detail::table_command cmd;
+		cmd.what = detail::table_command::kind::erase;
+		cmd.index = id.index;
+		push(check(id), std::move(cmd));
+	}
+
+	/** Queue a function to run on the worker of a table, waiting while the queue is full
+	 * An exception of fn is given to options.on_error.
+	 * @param id The table
+	 * @param fn A function taking table&
+	 */
+	template <class F>
+	void submit(table_id id, F&& fn)
+	{
+		detail::table_command cmd;
+		cmd.index = id.index;
+		cmd.fn = [fn = std::forward<F>(fn)](table *tb) mutable { fn(detail::table_of(tb)); };
+		push(check(id), std::move(cmd));
+	}
+
+	/** Queue a function to run on the worker of a table, if the queue has room
+	 * @param id The table
+	 * @param fn A function taking table&
+	 * @return Whether the function was queued
+	 */
+	template <class F>
+	bool try_submit(table_id id, F&& fn)
+	{
+		detail::table_command cmd;
+		cmd.index = id.index;
+		cmd.fn = [fn = std::forward<F>(fn)](table *tb) mutable { fn(detail::table_of(tb)); };
+		shard& sh = *shards[check(id)];
+		if (!sh.queue.try_push(std::move(cmd))) {
+			return false;
+		}
+		wake(sh, false);
+		return true;
+	}
+
+	/** Run a function on the worker of a table and get its result
+	 * @param id The table
+	 * @param fn A function taking table&
+	 * @return The future result or exception of fn, or out_of_range if the table was erased
+	 */
+	template <class F>
+	auto call(table_id id, F&& fn) -> std::future<std::invoke_result_t<F&, table&>>
+	{
+		using result = std::invoke_result_t<F&, table&>;
+		std::promise<result> done;
+		std::future<result> future = done.get_future();
+		detail::table_command cmd;
+		cmd.index = id.index;
+		cmd.fn = [done = std::move(done), fn = std::forward<F>(fn)](table *tb) mutable {
+			try {
+				if constexpr (std::is_void_v<result>) {
+					fn(detail::table_of(tb));
+					done.set_value();
+				} else {
+					done.set_value(fn(detail::table_of(tb)));
+				}
+			} catch (...) {
+				done.set_exception(std::current_exception());
+			}
+		};
+		push(check(id), std::move(cmd));
+		return future;
+	}
+
+	/** Shuffle the pile of a table with its own engine, see poker::shuffle */
+	void shuffle(table_id id, poker::shuffle_mode mode = poker::shuffle_mode::fisher_yates)
+	{
+		submit(id, [mode](table& tb) { tb.game.shuffle(tb.generator, mode); });
+	}
+
+	/** Put every card of a table back into its pile, see poker::reset */
+	void reset(table_id id)
+	{
+		submit(id, [](table& tb) { tb.game.reset(); });
+	}
+
+	/** Deal cards to every player of a table, see poker::deal */
+	std::future<void> deal(table_id id, unsigned int card_per_person)
+	{
+		return call(id, [card_per_person](table& tb) { tb.game.deal(card_per_person); });
+	}
+
+	/** Draw a card of a table to a player, see poker::draw */
+	std::future<card> draw(table_id id, unsigned int player_no)
+	{
+		return call(id, [player_no](table& tb) { return tb.game.draw(player_no); });
+	}
+
+	/** Play a card of a player of a table, see poker::play */
+	std::future<void> play(table_id id, unsigned int player_no, card const& c,
+		deck::remove_mode mode = deck::remove_mode::stable)
+	{
+		return call(id, [player_no, c, mode](table& tb) { tb.game.play(player_no, c, mode); });
+	}
+
+private:
+	struct alignas(cache_line) shard {
+		explicit shard(std::size_t capacity) : queue{capacity}
+		{
+		}
+
+		detail::mpsc_queue<detail::table_command> queue;
+		std::vector<std::unique_ptr<table>> tables; /**< Touched by the worker only */
+		std::atomic<std::uint32_t> next_index{0};
+		alignas(cache_line) std::atomic<bool> sleeping{false};
+		std::mutex lock; /**< Held only to sleep and to wake the worker */
+		std::condition_variable wakeup;
+		std::thread worker;
+	};
+
+	std::uint32_t check(table_id id) const
+	{
+		if (id.shard >= shards.size() || id.index >= shards[id.shard]->next_index.load(std::memory_order_relaxed)) {
+			throw std::out_of_range("Unknown table");
+		}
+		return id.shard;
+	}
+
+	void push(std::uint32_t s, detail::table_command&& cmd)
+	{
+		shard& sh = *shards[s];
+		while (!sh.queue.try_push(std::move(cmd))) {
+			wake(sh, false);
+			std::this_thread::yield();
+		}
+		wake(sh, false);
+	}
+
+	static void wake(shard& sh, bool always)
+	{
+		// Pairs with the store of sleeping before the worker checks the queue again
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (always || sh.sleeping.load(std::memory_order_relaxed)) {
+			{
+				std::lock_guard<std::mutex> guard{sh.lock};
+			}
+			sh.wakeup.notify_one();
+		}
+	}
+
+	/** Run one command; whatever it throws is reported, so that the worker goes on with the next */
+	void execute(shard& sh, table_id id, detail::table_command& cmd)
+	{
+		try {
+			if (sh.tables.size() <= cmd.index) {
+				sh.tables.resize(cmd.index + 1);
+			}
+			std::unique_ptr<table>& slot = sh.tables[cmd.index];
+			switch (cmd.what) {
+			case detail::table_command::kind::create:
+				slot.reset(new table{cmd.deck, cmd.player, cmd.joker, cmd.seed});
+				return;
+			case detail::table_command::kind::erase:
+				slot.reset();
+				return;
+			case detail::table_command::kind::run:
+				cmd.fn(slot.get());
+				return;
+			}
+		} catch (...) {
+			report(id, std::current_exception());
+		}
+	}
+
+	void report(table_id id, std::exception_ptr e) noexcept
+	{
+		if (!options.on_error) {
+			return;
+		}
+		try {
+			options.on_error(id, e);
+		} catch (...) {
+			// An error of the handler has nowhere else to go, and must not stop the worker
+		}
+	}
+
+	void run(unsigned int s)
+	{
+		shard& sh = *shards[s];
+		detail::table_command cmd;
+		unsigned int spins = 0;
+		for (;;) {
+			while (sh.queue.try_pop(cmd)) {
+				execute(sh, table_id{s, cmd.index}, cmd);
+				cmd = detail::table_command{};
+				spins = 0;
+			}
+			if (stopping.load(std::memory_order_acquire) && sh.queue.empty()) {
+				return;
+			}
+			if (++spins < 64) {
+				std::this_thread::yield();
+				continue;
+			}
+			std::unique_lock<std::mutex> guard{sh.lock};
+			sh.sleeping.store(true, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			sh.wakeup.wait(guard, [&] {
+				return !sh.queue.empty() || stopping.load(std::memory_order_acquire);
+			});
+			sh.sleeping.store(false, std::memory_order_relaxed);
+			spins = 0;
+		}
+	}
+
+	table_service_options options;
+	std::vector<std::unique_ptr<shard>> shards;
+	alignas(cache_line) std::atomic<std::uint64_t> created{0}; /**< The tables created, for round robin */
+	std::atomic<bool> stopping{false};
+};
+
+} // namespace pk
+#endif // TABLE_SERVICE_H_